@@ -21,22 +21,80 @@
 
 #include "insight/insight.hpp"
 #include <string.h>
+#include <math.h>
+#include <float.h>
 
 /**
  * @brief Defines the size of the data buffer used to transmit data to the host.
  * 
- * First byte is the header, followed the payload size and finally the payload 
- * itself. As we dont know what payload type will be used we assume 8 bytes per 
- * value.
+ * First byte is the header, followed the payload size, the optional sequence 
+ * number and finally the payload itself. The length of a frame is given by a 
+ * single byte.
  */
-#define INSIGHT_DATABUFFERSIZ   (2 + (INSIGHT_NUMVALUES*8))
+#define INSIGHT_DATABUFFERSIZ   (2 + UINT8_MAX)
 
 /**
- * @brief As only one byte is used to specify the payload site it is limited to
- * UINT8_8_MAX.
+ * @brief The sequence number is 8 bit wide and the host acknowledges up to 32 
+ * frames at once.
  */
-#if (INSIGHT_NUMVALUES*8) > UINT8_MAX
-#error "ERROR: Max Data buffer size violated, reduce INSIGHT_NUMVALUES!"
+#if (INSIGHT_ARQWINDOW & (INSIGHT_ARQWINDOW - 1)) != 0 || INSIGHT_ARQWINDOW > 32
+#error "ERROR: INSIGHT_ARQWINDOW has to be a power of two, 32 at most!"
+#endif
+
+/**
+ * @brief Data and parity coefficients are distinct elements of GF(256). The 
+ * interleaved frames of a block have to be identified by their 8 bit sequence 
+ * number, so it must not repeat within a block.
+ */
+#if INSIGHT_FECBLOCK > 0 && \
+    (INSIGHT_FECBLOCK + INSIGHT_FECPARITY > 256 || INSIGHT_FECPARITY < 1 || \
+     INSIGHT_FECDEPTH < 1 || INSIGHT_FECDEPTH > UINT8_MAX || \
+     INSIGHT_FECBLOCK * INSIGHT_FECDEPTH > 256)
+#error "ERROR: Invalid forward error correction configuration!"
+#endif
+
+/**
+ * @brief Predictive frames take at most 34 bits per residual, see 
+ * transmitPredictive().
+ */
+#if INSIGHT_NUMPREDICTIVE > 0 && \
+    (INSIGHT_RICEBLOCK < 4 || (16 + (INSIGHT_RICEBLOCK*34 + 7)/8) > UINT8_MAX)
+#error "ERROR: INSIGHT_RICEBLOCK has to be in the range from 4 to 55!"
+#endif
+
+/**
+ * @brief Encoded frames depend on the previous frame, see transmit(). 
+ */
+#if INSIGHT_KEYFRAME > 0 && INSIGHT_SEQUENCED
+#error "ERROR: INSIGHT_KEYFRAME can't be combined with ARQ or FEC!"
+#endif
+
+#if INSIGHT_KEYFRAME > UINT8_MAX
+#error "ERROR: INSIGHT_KEYFRAME has to be 255 at most!"
+#endif
+
+/**
+ * @brief Histograms are transmitted in a single frame, see addHistogram(...).
+ */
+#if INSIGHT_NUMHISTOGRAMS > 0 && \
+    ((10 + INSIGHT_HISTBUCKETS*2) > UINT8_MAX || INSIGHT_HISTBUCKETS < 2)
+#error "ERROR: Histogram frame size violated, check INSIGHT_HISTBUCKETS!"
+#endif
+
+/**
+ * @brief Segments are frames as well, the offset byte is added to the data, 
+ * see transmitSegment().
+ */
+#if INSIGHT_SEGMENTSIZ < 1 || INSIGHT_SEGMENTSIZ > UINT8_MAX - 1
+#error "ERROR: INSIGHT_SEGMENTSIZ has to be in the range from 1 to 254!"
+#endif
+
+/**
+ * @brief Spectra are transmitted in a single frame, see addSpectrum(...).
+ */
+#if (INSIGHT_SPECTRUMSIZ & (INSIGHT_SPECTRUMSIZ - 1)) != 0 || \
+    INSIGHT_SPECTRUMSIZ < 4 || INSIGHT_SPECTRUMSIZ > 128
+#error "ERROR: INSIGHT_SPECTRUMSIZ has to be a power of two from 4 to 128!"
 #endif
 
 /**
@@ -49,10 +107,52 @@ const struct
     const char STX = 0x02;  /** Start of text (data only) */
     const char ETX = 0x03;  /** End of text (data or header) */
     const char EOT = 0x04;  /** End of transmission */
+    const char SI  = 0x0f;  /** Shift in (segment of large frames) */
+    const char ACK = 0x06;  /** Acknowledge (received from the host) */
+    const char DLE = 0x10;  /** Data link escape (sequenced data only) */
+    const char ETB = 0x17;  /** End of transmission block (parity) */
+    const char DC1 = 0x11;  /** Device control 1 (marker) */
+    const char DC2 = 0x12;  /** Device control 2 (log message) */
+    const char DC3 = 0x13;  /** Device control 3 (histogram) */
+    const char DC4 = 0x14;  /** Device control 4 (spectrum) */
+    const char SUB = 0x1a;  /** Substitute (encoded data only) */
+    const char EM  = 0x19;  /** End of medium (predictive coded block) */
     const char ESC = 0x1b;  /** Escape for all above */
 
 }ctrl;
 
+/**
+ * @brief Tells if float and double are IEEE 754 binary32 and binary64, or 
+ * binary32 both as on some 8 bit targets.
+ */
+#define INSIGHT_FLOAT_IEEE      (FLT_RADIX == 2 && FLT_MANT_DIG == 24 && \
+                                 FLT_MAX_EXP == 128)
+#define INSIGHT_DOUBLE_IEEE     (FLT_RADIX == 2 && \
+                                 ((DBL_MANT_DIG == 53 && DBL_MAX_EXP == 1024) ||\
+                                  (DBL_MANT_DIG == 24 && DBL_MAX_EXP == 128)))
+
+/**
+ * @brief The codes of the adaptive encoding, see transmit().
+ */
+typedef enum {
+
+    code_raw        = 0,    /** The raw value */
+    code_delta      = 1,    /** The difference as zig zag varint */
+    code_repeat     = 2     /** Unchanged, nothing transmitted */
+
+}code_t;
+
+/**
+ * @brief The states of a frame in the retransmission window.
+ */
+typedef enum {
+
+    arqState_free    = 0,   /** Unused or acknowledged by the host */
+    arqState_sent    = 1,   /** Waiting for the acknowledge */
+    arqState_lost    = 2    /** Reported missing by the host */
+
+}arqState_t;
+
 /**
  * @brief Defines the data to know per supported data type.
  */
@@ -81,43 +181,228 @@ const PayloadSpec_t PayloadSpec[11] =
         {sizeof(double),    "d"}
 };
 
-Insight::Insight() :
+#if INSIGHT_FECBLOCK > 0
+
+/**
+ * @brief GF(256) exponentials of the generator 2, doubled to skip the modulo.
+ */
+const uint8_t GfExp[512] =
+{
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1d, 0x3a, 0x74, 0xe8,
+    0xcd, 0x87, 0x13, 0x26, 0x4c, 0x98, 0x2d, 0x5a, 0xb4, 0x75, 0xea, 0xc9,
+    0x8f, 0x03, 0x06, 0x0c, 0x18, 0x30, 0x60, 0xc0, 0x9d, 0x27, 0x4e, 0x9c,
+    0x25, 0x4a, 0x94, 0x35, 0x6a, 0xd4, 0xb5, 0x77, 0xee, 0xc1, 0x9f, 0x23,
+    0x46, 0x8c, 0x05, 0x0a, 0x14, 0x28, 0x50, 0xa0, 0x5d, 0xba, 0x69, 0xd2,
+    0xb9, 0x6f, 0xde, 0xa1, 0x5f, 0xbe, 0x61, 0xc2, 0x99, 0x2f, 0x5e, 0xbc,
+    0x65, 0xca, 0x89, 0x0f, 0x1e, 0x3c, 0x78, 0xf0, 0xfd, 0xe7, 0xd3, 0xbb,
+    0x6b, 0xd6, 0xb1, 0x7f, 0xfe, 0xe1, 0xdf, 0xa3, 0x5b, 0xb6, 0x71, 0xe2,
+    0xd9, 0xaf, 0x43, 0x86, 0x11, 0x22, 0x44, 0x88, 0x0d, 0x1a, 0x34, 0x68,
+    0xd0, 0xbd, 0x67, 0xce, 0x81, 0x1f, 0x3e, 0x7c, 0xf8, 0xed, 0xc7, 0x93,
+    0x3b, 0x76, 0xec, 0xc5, 0x97, 0x33, 0x66, 0xcc, 0x85, 0x17, 0x2e, 0x5c,
+    0xb8, 0x6d, 0xda, 0xa9, 0x4f, 0x9e, 0x21, 0x42, 0x84, 0x15, 0x2a, 0x54,
+    0xa8, 0x4d, 0x9a, 0x29, 0x52, 0xa4, 0x55, 0xaa, 0x49, 0x92, 0x39, 0x72,
+    0xe4, 0xd5, 0xb7, 0x73, 0xe6, 0xd1, 0xbf, 0x63, 0xc6, 0x91, 0x3f, 0x7e,
+    0xfc, 0xe5, 0xd7, 0xb3, 0x7b, 0xf6, 0xf1, 0xff, 0xe3, 0xdb, 0xab, 0x4b,
+    0x96, 0x31, 0x62, 0xc4, 0x95, 0x37, 0x6e, 0xdc, 0xa5, 0x57, 0xae, 0x41,
+    0x82, 0x19, 0x32, 0x64, 0xc8, 0x8d, 0x07, 0x0e, 0x1c, 0x38, 0x70, 0xe0,
+    0xdd, 0xa7, 0x53, 0xa6, 0x51, 0xa2, 0x59, 0xb2, 0x79, 0xf2, 0xf9, 0xef,
+    0xc3, 0x9b, 0x2b, 0x56, 0xac, 0x45, 0x8a, 0x09, 0x12, 0x24, 0x48, 0x90,
+    0x3d, 0x7a, 0xf4, 0xf5, 0xf7, 0xf3, 0xfb, 0xeb, 0xcb, 0x8b, 0x0b, 0x16,
+    0x2c, 0x58, 0xb0, 0x7d, 0xfa, 0xe9, 0xcf, 0x83, 0x1b, 0x36, 0x6c, 0xd8,
+    0xad, 0x47, 0x8e, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1d,
+    0x3a, 0x74, 0xe8, 0xcd, 0x87, 0x13, 0x26, 0x4c, 0x98, 0x2d, 0x5a, 0xb4,
+    0x75, 0xea, 0xc9, 0x8f, 0x03, 0x06, 0x0c, 0x18, 0x30, 0x60, 0xc0, 0x9d,
+    0x27, 0x4e, 0x9c, 0x25, 0x4a, 0x94, 0x35, 0x6a, 0xd4, 0xb5, 0x77, 0xee,
+    0xc1, 0x9f, 0x23, 0x46, 0x8c, 0x05, 0x0a, 0x14, 0x28, 0x50, 0xa0, 0x5d,
+    0xba, 0x69, 0xd2, 0xb9, 0x6f, 0xde, 0xa1, 0x5f, 0xbe, 0x61, 0xc2, 0x99,
+    0x2f, 0x5e, 0xbc, 0x65, 0xca, 0x89, 0x0f, 0x1e, 0x3c, 0x78, 0xf0, 0xfd,
+    0xe7, 0xd3, 0xbb, 0x6b, 0xd6, 0xb1, 0x7f, 0xfe, 0xe1, 0xdf, 0xa3, 0x5b,
+    0xb6, 0x71, 0xe2, 0xd9, 0xaf, 0x43, 0x86, 0x11, 0x22, 0x44, 0x88, 0x0d,
+    0x1a, 0x34, 0x68, 0xd0, 0xbd, 0x67, 0xce, 0x81, 0x1f, 0x3e, 0x7c, 0xf8,
+    0xed, 0xc7, 0x93, 0x3b, 0x76, 0xec, 0xc5, 0x97, 0x33, 0x66, 0xcc, 0x85,
+    0x17, 0x2e, 0x5c, 0xb8, 0x6d, 0xda, 0xa9, 0x4f, 0x9e, 0x21, 0x42, 0x84,
+    0x15, 0x2a, 0x54, 0xa8, 0x4d, 0x9a, 0x29, 0x52, 0xa4, 0x55, 0xaa, 0x49,
+    0x92, 0x39, 0x72, 0xe4, 0xd5, 0xb7, 0x73, 0xe6, 0xd1, 0xbf, 0x63, 0xc6,
+    0x91, 0x3f, 0x7e, 0xfc, 0xe5, 0xd7, 0xb3, 0x7b, 0xf6, 0xf1, 0xff, 0xe3,
+    0xdb, 0xab, 0x4b, 0x96, 0x31, 0x62, 0xc4, 0x95, 0x37, 0x6e, 0xdc, 0xa5,
+    0x57, 0xae, 0x41, 0x82, 0x19, 0x32, 0x64, 0xc8, 0x8d, 0x07, 0x0e, 0x1c,
+    0x38, 0x70, 0xe0, 0xdd, 0xa7, 0x53, 0xa6, 0x51, 0xa2, 0x59, 0xb2, 0x79,
+    0xf2, 0xf9, 0xef, 0xc3, 0x9b, 0x2b, 0x56, 0xac, 0x45, 0x8a, 0x09, 0x12,
+    0x24, 0x48, 0x90, 0x3d, 0x7a, 0xf4, 0xf5, 0xf7, 0xf3, 0xfb, 0xeb, 0xcb,
+    0x8b, 0x0b, 0x16, 0x2c, 0x58, 0xb0, 0x7d, 0xfa, 0xe9, 0xcf, 0x83, 0x1b,
+    0x36, 0x6c, 0xd8, 0xad, 0x47, 0x8e, 0x01, 0x02
+};
+
+/**
+ * @brief GF(256) logarithms to the base 2, GfLog[0] is not defined.
+ */
+const uint8_t GfLog[256] =
+{
+    0x00, 0x00, 0x01, 0x19, 0x02, 0x32, 0x1a, 0xc6, 0x03, 0xdf, 0x33, 0xee,
+    0x1b, 0x68, 0xc7, 0x4b, 0x04, 0x64, 0xe0, 0x0e, 0x34, 0x8d, 0xef, 0x81,
+    0x1c, 0xc1, 0x69, 0xf8, 0xc8, 0x08, 0x4c, 0x71, 0x05, 0x8a, 0x65, 0x2f,
+    0xe1, 0x24, 0x0f, 0x21, 0x35, 0x93, 0x8e, 0xda, 0xf0, 0x12, 0x82, 0x45,
+    0x1d, 0xb5, 0xc2, 0x7d, 0x6a, 0x27, 0xf9, 0xb9, 0xc9, 0x9a, 0x09, 0x78,
+    0x4d, 0xe4, 0x72, 0xa6, 0x06, 0xbf, 0x8b, 0x62, 0x66, 0xdd, 0x30, 0xfd,
+    0xe2, 0x98, 0x25, 0xb3, 0x10, 0x91, 0x22, 0x88, 0x36, 0xd0, 0x94, 0xce,
+    0x8f, 0x96, 0xdb, 0xbd, 0xf1, 0xd2, 0x13, 0x5c, 0x83, 0x38, 0x46, 0x40,
+    0x1e, 0x42, 0xb6, 0xa3, 0xc3, 0x48, 0x7e, 0x6e, 0x6b, 0x3a, 0x28, 0x54,
+    0xfa, 0x85, 0xba, 0x3d, 0xca, 0x5e, 0x9b, 0x9f, 0x0a, 0x15, 0x79, 0x2b,
+    0x4e, 0xd4, 0xe5, 0xac, 0x73, 0xf3, 0xa7, 0x57, 0x07, 0x70, 0xc0, 0xf7,
+    0x8c, 0x80, 0x63, 0x0d, 0x67, 0x4a, 0xde, 0xed, 0x31, 0xc5, 0xfe, 0x18,
+    0xe3, 0xa5, 0x99, 0x77, 0x26, 0xb8, 0xb4, 0x7c, 0x11, 0x44, 0x92, 0xd9,
+    0x23, 0x20, 0x89, 0x2e, 0x37, 0x3f, 0xd1, 0x5b, 0x95, 0xbc, 0xcf, 0xcd,
+    0x90, 0x87, 0x97, 0xb2, 0xdc, 0xfc, 0xbe, 0x61, 0xf2, 0x56, 0xd3, 0xab,
+    0x14, 0x2a, 0x5d, 0x9e, 0x84, 0x3c, 0x39, 0x53, 0x47, 0x6d, 0x41, 0xa2,
+    0x1f, 0x2d, 0x43, 0xd8, 0xb7, 0x7b, 0xa4, 0x76, 0xc4, 0x17, 0x49, 0xec,
+    0x7f, 0x0c, 0x6f, 0xf6, 0x6c, 0xa1, 0x3b, 0x52, 0x29, 0x9d, 0x55, 0xaa,
+    0xfb, 0x60, 0x86, 0xb1, 0xbb, 0xcc, 0x3e, 0x5a, 0xcb, 0x59, 0x5f, 0xb0,
+    0x9c, 0xa9, 0xa0, 0x51, 0x0b, 0xf5, 0x16, 0xeb, 0x7a, 0x75, 0x2c, 0xd7,
+    0x4f, 0xae, 0xd5, 0xe9, 0xe6, 0xe7, 0xad, 0xe8, 0x74, 0xd6, 0xf4, 0xea,
+    0xa8, 0x50, 0x58, 0xaf
+};
+
+#endif
+
+InsightBase::InsightBase(const Storage_t &storage) :
       Enabled(false)
     , Pause(false)
     , LastTick(0)
     , Period(INSIGHT_TASKPERIOD_MS)
+    , FrameTime(0)
+    , DerivedTime(0)
+    , NameBuffer(storage.names)
+    , NameBufferSiz(storage.namesSiz)
+    , Payload(storage.payload)
+    , NumValues(storage.numValues)
+    , CopyOps(storage.copyOps)
+    , Aligned(false)
+    , PadSize(0)
+    , FrameSiz(storage.frameSiz)
+    , Derived(storage.derived)
+    , NumDerived(storage.numDerived)
+#if INSIGHT_ARQWINDOW > 0
+    , WindowData(storage.frames)
+#endif
+#if INSIGHT_KEYFRAME > 0
+    , PrevFrame(&storage.frames[(INSIGHT_NUMFRAMEBUFFERS - 1) * 
+            storage.frameSiz])
+#endif
+#if INSIGHT_FECBLOCK > 0
+    , FecParity(&storage.frames[INSIGHT_ARQWINDOW * storage.frameSiz])
+#endif
+    , Strings(storage.strings)
+    , NumStrings(storage.numStrings)
+    , Events(storage.events, storage.eventsSiz)
+    , Logs(storage.logs, storage.logsSiz)
+    , Bulk(storage.bulk, storage.bulkSiz)
 {
     reset();
     setStream(&Serial);
 }
 
-void Insight::reset(void)
+void InsightBase::reset(void)
 {
-    memset(NameBuffer, 0, sizeof(NameBuffer));
+    memset(NameBuffer, 0, NameBufferSiz);
     NameBufferPos = 0;
     
-    memset(Payload, 0, sizeof(Payload));
+    memset(Payload, 0, NumValues * sizeof(Payload_t));
     PayloadIdx = 0;
 
+    memset(CopyOps, 0, NumValues * sizeof(CopyOp_t));
+    CopyOpsIdx = 0;
+
     PayloadSize = 2;
+
+    if (NumDerived > 0)
+    {
+        memset(Derived, 0, NumDerived * sizeof(Derived_t));
+    }
+    DerivedIdx = 0;
+
+#if INSIGHT_NUMHISTOGRAMS > 0
+    memset(Histogram, 0, sizeof(Histogram));
+    HistogramIdx = 0;
+    HistogramBank = 0;
+#endif
+
+#if INSIGHT_NUMPREDICTIVE > 0
+    memset(Predictive, 0, sizeof(Predictive));
+    PredictiveIdx = 0;
+#endif
+
+#if INSIGHT_NUMSPECTRA > 0
+    memset(Spectrum, 0, sizeof(Spectrum));
+    SpectrumIdx = 0;
+    SpectrumPos = 0;
+
+    for (uint16_t k = 0; k <= INSIGHT_SPECTRUMSIZ/2; k++)
+    {
+        SpectrumCos[k] = cosf(2 * (float)M_PI * k / INSIGHT_SPECTRUMSIZ);
+    }
+#endif
+
+    if (NumStrings > 0)
+    {
+        memset(Strings, 0, NumStrings * sizeof(String_t));
+    }
+    StringsIdx = 0;
+    BulkSkip = 0;
+    Dropped = 0;
+
+#if INSIGHT_SEQUENCED
+    Seq = 0;
+#endif
+
+#if INSIGHT_ARQWINDOW > 0
+    memset(Window, 0, sizeof(Window));
+    AckBufferPos = 0;
+#endif
+
+#if INSIGHT_FECBLOCK > 0
+    memset(Fec, 0, sizeof(Fec));
+    memset(FecParity, 0, INSIGHT_FECDEPTH * INSIGHT_FECPARITY * FrameSiz);
+    FecIdx = 0;
+#endif
 }
 
-void Insight::setStream(Stream *pIoStr)
+void InsightBase::setStream(Stream *pIoStr)
 {
     pStream = pIoStr;
 }
 
-void Insight::setPeriod(uint32_t millis)
+void InsightBase::setPeriod(uint32_t millis)
 {
     Period = millis;
 }
 
-uint32_t Insight::getPeriod(void)
+void InsightBase::printLayout(void)
+{
+    const uint16_t probe = 1;
+
+    pStream->printf("W=%c,%u,%c%u,%c%u;", 
+            (*(const uint8_t*) &probe == 1) ? 'L' : 'B',
+            (unsigned) sizeof(bool),
+            INSIGHT_FLOAT_IEEE ? 'F' : 'X', (unsigned) sizeof(float) * 8,
+            INSIGHT_DOUBLE_IEEE ? 'F' : 'X', (unsigned) sizeof(double) * 8);
+}
+
+void InsightBase::setAligned(bool state)
+{
+    Aligned = state;
+}
+
+uint32_t InsightBase::getPeriod(void)
 {
     return Period;
 }
 
-bool Insight::enable(bool state, bool sync)
+uint32_t InsightBase::getDropped(void)
+{
+    return Dropped;
+}
+
+bool InsightBase::enable(bool state, bool sync)
 {
     if (Enabled == state)
     {
@@ -132,17 +417,119 @@ bool Insight::enable(bool state, bool sync)
             return false;
         }
 
+        if (!compile())
+        {
+            return false;
+        }
+
         pStream->write(ctrl.SOH);
         pStream->printf(INSIGHT_BINARYINFO_FMT);
-        pStream->printf("%s", NameBuffer);
+
+        /* Names and types are listed in the order of transmission. */
+        for (uint8_t i = 0; i < PayloadIdx; i++)
+        {
+            const char *pName = (const char*) &NameBuffer[Payload[i].name];
+
+            pStream->write((const uint8_t*) pName, 
+                    strchr(pName, ';') - pName + 1);
+        }
 
         for (uint8_t i = 0; i < PayloadIdx; i++)
         {
             pStream->printf("%s;", PayloadSpec[Payload[i].type].hdr);    
         }
+
+        /* Optional entries follow the data types. They are made of a tag, an 
+         * optional id, a equal sign and the value. Hosts shall ignore those 
+         * entries they don't know. */
+        printLayout();
+
+        if (Aligned)
+        {
+            pStream->printf("P=%u;", PadSize);
+        }
+
+#if INSIGHT_ARQWINDOW > 0
+        /* Tell the host that data frames have to be acknowledged. */
+        pStream->printf("A=%u;", INSIGHT_ARQWINDOW);
+#endif
+
+#if INSIGHT_KEYFRAME > 0
+        /* Tell the host to expect encoded frames. */
+        pStream->printf("K=%u;", INSIGHT_KEYFRAME);
+#endif
+
+#if INSIGHT_FECBLOCK > 0
+        /* Tell the host how to use parity frames. */
+        pStream->printf("E=%u,%u,%u;", INSIGHT_FECBLOCK, INSIGHT_FECPARITY, 
+                INSIGHT_FECDEPTH);
+#endif
+
+        for (uint8_t i = 0; i < StringsIdx; i++)
+        {
+            pStream->printf("%c%u=%s;", Strings[i].tag, Strings[i].id, 
+                    Strings[i].str);
+        }
         
         pStream->write(ctrl.ETX);
 
+        /* Drop frames which have been queued before the header. */
+        Events.clear();
+        Logs.clear();
+        Bulk.clear();
+        BulkSkip = 0;
+        Dropped = 0;
+
+        /* Histograms as well as derived values start over with each 
+         * transmission. */
+#if INSIGHT_NUMHISTOGRAMS > 0
+        for (uint8_t i = 0; i < HistogramIdx; i++)
+        {
+            memset(Histogram[i].bins, 0, sizeof(Histogram[i].bins));
+        }
+#endif
+
+        for (uint8_t i = 0; i < DerivedIdx; i++)
+        {
+            Derived[i].valid = false;
+        }
+
+#if INSIGHT_ARQWINDOW > 0
+        memset(Window, 0, sizeof(Window));
+        AckBufferPos = 0;
+#endif
+
+#if INSIGHT_FECBLOCK > 0
+        memset(Fec, 0, sizeof(Fec));
+        memset(FecParity, 0, INSIGHT_FECDEPTH * INSIGHT_FECPARITY * FrameSiz);
+        FecIdx = 0;
+#endif
+
+#if INSIGHT_KEYFRAME > 0
+        for (uint8_t i = 0; i < PayloadIdx; i++)
+        {
+            Payload[i].code = code_raw;
+            Payload[i].raw = 0;
+            Payload[i].delta = 0;
+        }
+
+        FrameCnt = 0;
+#endif
+
+#if INSIGHT_NUMPREDICTIVE > 0
+        for (uint8_t i = 0; i < PredictiveIdx; i++)
+        {
+            Predictive[i].cnt = 0;
+        }
+#endif
+
+#if INSIGHT_NUMSPECTRA > 0
+        for (uint8_t i = 0; i < SpectrumIdx; i++)
+        {
+            memset(Spectrum[i].samples, 0, sizeof(Spectrum[i].samples));
+        }
+#endif
+
         /* If sync is requested manipulate the LastTick value to cause the task
          * function in it'S next call to become active. */
         if(sync)
@@ -161,12 +548,12 @@ bool Insight::enable(bool state, bool sync)
     return true;
 }
 
-bool Insight::isEnabled(void)
+bool InsightBase::isEnabled(void)
 {
     return Enabled;
 }
 
-void Insight::pause(bool state, bool sync)
+void InsightBase::pause(bool state, bool sync)
 {
     Pause = state;
 
@@ -178,86 +565,96 @@ void Insight::pause(bool state, bool sync)
     }
 }
 
-bool Insight::isPaused(void)
+bool InsightBase::isPaused(void)
 {
     return Pause;
 }
 
-bool Insight::add(bool *ptr, const char *str)
+bool InsightBase::add(bool *ptr, const char *str)
 {
     return add(ptr, dataType_bool, str);
 }
 
-bool Insight::add(uint8_t *ptr, const char *str)
+bool InsightBase::add(uint8_t *ptr, const char *str)
 {
     return add(ptr, dataType_uint_8, str);
 }
 
-bool Insight::add(uint16_t *ptr, const char *str)
+bool InsightBase::add(uint16_t *ptr, const char *str)
 {
     return add(ptr, dataType_uint_16, str);
 }
 
-bool Insight::add(uint32_t *ptr, const char *str)
+bool InsightBase::add(uint32_t *ptr, const char *str)
 {
     return add(ptr, dataType_uint_32, str);
 }
 
-bool Insight::add(uint64_t *ptr, const char *str)
+bool InsightBase::add(uint64_t *ptr, const char *str)
 {
     return add(ptr, dataType_uint_64, str);
 }
 
-bool Insight::add(int8_t *ptr, const char *str)
+bool InsightBase::add(int8_t *ptr, const char *str)
 {
     return add(ptr, dataType_int_8, str);
 }
 
-bool Insight::add(int16_t *ptr, const char *str)
+bool InsightBase::add(int16_t *ptr, const char *str)
 {
     return add(ptr, dataType_int_16, str);
 }
 
-bool Insight::add(int32_t *ptr, const char *str)
+bool InsightBase::add(int32_t *ptr, const char *str)
 {
     return add(ptr, dataType_int_32, str);
 }
 
-bool Insight::add(int64_t *ptr, const char *str)
+bool InsightBase::add(int64_t *ptr, const char *str)
 {
     return add(ptr, dataType_int_64, str);
 }
 
-bool Insight::add(float *ptr, const char *str)
+bool InsightBase::add(float *ptr, const char *str)
 {
     return add(ptr, dataType_float, str);
 }
 
-bool Insight::add(double *ptr, const char *str)
+bool InsightBase::add(double *ptr, const char *str)
 {
     return add(ptr, dataType_double, str);
 }
 
-bool Insight::add(void *ptr, dataTypes_t type, const char *name)
+bool InsightBase::add(void *ptr, dataTypes_t type, const char *name)
 {
     /* While enabled, internal data has to be locked as it is used while 
      * transmitting data. */
-    if (Enabled || (PayloadIdx == INSIGHT_NUMVALUES))
+    if (Enabled || (PayloadIdx == NumValues))
     {
         return false;
     }
 
-    size_t size = INSIGHT_NAMEBUFFERSIZ - NameBufferPos;
+    size_t size = NameBufferSiz - NameBufferPos;
     if (size == 0)
     {
         /* No place left in the buffer; */
         return false;
     }
 
-    if (PayloadSize + PayloadSpec[type].siz > INSIGHT_DATABUFFERSIZ)
+    if (PayloadSize - 2 + PayloadSpec[type].siz > FrameSiz)
+    {
+        return false;
+    }
+
+#if INSIGHT_KEYFRAME > 0
+    /* Encoded frames take two bits per variable in addition, at most they 
+     * are as large as the raw payload. */
+    if (PayloadSize - 2 + PayloadSpec[type].siz + (PayloadIdx + 4) / 4 > 
+        UINT8_MAX)
     {
         return false;
     }
+#endif
 
     int written = snprintf((char*) &NameBuffer[NameBufferPos], 
             size, "%s;", name);
@@ -266,6 +663,7 @@ bool Insight::add(void *ptr, dataTypes_t type, const char *name)
      * then the name does not fit into the buffer. */
     if ((written > 0) && (written < size))
     {
+        Payload[PayloadIdx].name = NameBufferPos;
         NameBufferPos+=written;
         Payload[PayloadIdx].ptr = ptr;
         Payload[PayloadIdx].type = type;
@@ -283,50 +681,1316 @@ bool Insight::add(void *ptr, dataTypes_t type, const char *name)
     return true;
 }
 
-bool Insight::transmit(void)
+bool InsightBase::compile(void)
 {
-    uint8_t buffer[32];
-    uint8_t idx = 0;
+    /* A stable insertion sort. The name offsets reflect the order of add(...) 
+     * calls, so sorting by them restores the default layout in case it has 
+     * been sorted before. */
+    for (uint8_t i = 1; i < PayloadIdx; i++)
+    {
+        Payload_t tmp = Payload[i];
+        size_t siz = PayloadSpec[tmp.type].siz;
+        uint8_t j = i;
 
-    if (!Enabled)
+        while (j > 0)
+        {
+            size_t prevSiz = PayloadSpec[Payload[j-1].type].siz;
+
+            if ((Aligned && (siz != prevSiz)) ? (siz < prevSiz) : 
+                    (tmp.name > Payload[j-1].name))
+            {
+                break;
+            }
+
+            Payload[j] = Payload[j-1];
+            j--;
+        }
+
+        Payload[j] = tmp;
+    }
+
+    PadSize = 0;
+    if (Aligned)
     {
-        return false;
+        uint8_t align = PayloadSpec[Payload[0].type].siz;
+        uint16_t len = PayloadSize - 2;
+
+        PadSize = (align - (len % align)) % align;
+        if (len + PadSize > FrameSiz)
+        {
+            return false;
+        }
     }
 
-    /* Data transmission shall be fast as possible. As consequence I have 
-     * decided to:
-     *
-     * # Don't use explicit frame termination as this will result in the need of
-     *   escaping control characters.
-     *
-     * # Use a buffer to collect the data and dont transmit each value on it's 
-     *   own. At least my measurements have shown that this is faster.
-     */
-    buffer[idx++] = ctrl.STX;
-    buffer[idx++] = PayloadSize-2;
+    CopyOpsIdx = 0;
 
     for (uint8_t i = 0; i < PayloadIdx; i++)
     {
-        size_t siz = PayloadSpec[Payload[i].type].siz;
-        memcpy(&buffer[idx], (uint8_t*)Payload[i].ptr, siz);
-        idx+= siz;
+        const uint8_t *src = (const uint8_t*) Payload[i].ptr;
+        uint8_t siz = PayloadSpec[Payload[i].type].siz;
+
+        if ((CopyOpsIdx > 0) && 
+            (CopyOps[CopyOpsIdx-1].src + CopyOps[CopyOpsIdx-1].siz == src))
+        {
+            /* Adjacent to the previous one, the sum can't exceed the frame 
+             * size which is checked by add(...). */
+            CopyOps[CopyOpsIdx-1].siz += siz;
+            continue;
+        }
+
+        CopyOps[CopyOpsIdx].src = src;
+        CopyOps[CopyOpsIdx].siz = siz;
+        CopyOpsIdx++;
     }
 
-    pStream->write(buffer, idx);
+    return true;
+}
+
+bool InsightBase::addDerived(void *src, derivedTypes_t kind, const char *name, 
+        float alpha)
+{
+    static void (* const kernels[4])(Derived_t*, float, float, float) =
+    {
+        deriveDelta, deriveRate, deriveIntegral, deriveEma
+    };
+
+    uint8_t i = 0;
+
+    if (Enabled || (DerivedIdx == NumDerived) || 
+        ((unsigned) kind > derived_ema))
+    {
+        return false;
+    }
+
+    /* The source has to be part of the stream as we need to know it's type.*/
+    while ((i < PayloadIdx) && (Payload[i].ptr != src))
+    {
+        i++;
+    }
+
+    if (i == PayloadIdx)
+    {
+        return false;
+    }
+
+    Derived_t *pDrv = &Derived[DerivedIdx];
+    if (!add(&pDrv->out, dataType_float, name))
+    {
+        return false;
+    }
+
+    pDrv->kernel = kernels[kind];
+    pDrv->src = src;
+    pDrv->type = Payload[i].type;
+    pDrv->valid = false;
+    pDrv->alpha = alpha;
+    pDrv->out = 0;
+    DerivedIdx++;
 
     return true;
 }
 
-void Insight::task(uint32_t millis)
+void InsightBase::updateDerived(void)
 {
-    if(!Enabled || Pause)
+    float dt = (FrameTime - DerivedTime) / 1000.0f;
+
+    DerivedTime = FrameTime;
+
+    for (uint8_t i = 0; i < DerivedIdx; i++)
     {
-        return;
+        Derived_t *pDrv = &Derived[i];
+        float x, dx;
+
+        if (pDrv->type == dataType_float || pDrv->type == dataType_double)
+        {
+            double val = (pDrv->type == dataType_float) ? 
+                    *(float*)pDrv->src : *(double*)pDrv->src;
+
+            dx = pDrv->valid ? val - pDrv->prev.d : 0;
+            x = val;
+            pDrv->prev.d = val;
+        }
+        else
+        {
+            int64_t val;
+            uint8_t bits = PayloadSpec[pDrv->type].siz * 8;
+
+            switch (pDrv->type)
+            {
+                case dataType_bool:     val = *(bool*)pDrv->src;        break;
+                case dataType_uint_8:   val = *(uint8_t*)pDrv->src;     break;
+                case dataType_uint_16:  val = *(uint16_t*)pDrv->src;    break;
+                case dataType_uint_32:  val = *(uint32_t*)pDrv->src;    break;
+                case dataType_int_8:    val = *(int8_t*)pDrv->src;      break;
+                case dataType_int_16:   val = *(int16_t*)pDrv->src;     break;
+                case dataType_int_32:   val = *(int32_t*)pDrv->src;     break;
+                default:                val = *(int64_t*)pDrv->src;     break;
+            }
+
+            /* Differences are calculated in the width of the source, so a 
+             * counter wrapping around results in a small difference. */
+            uint64_t diff = (uint64_t)(val - pDrv->prev.i) << (64 - bits);
+            dx = pDrv->valid ? (int64_t)diff >> (64 - bits) : 0;
+            x = val;
+            pDrv->prev.i = val;
+        }
+
+        if (!pDrv->valid)
+        {
+            /* Nothing to compare with, just take the current value. */
+            pDrv->out = (pDrv->kernel == deriveEma) ? x : 0;
+            pDrv->valid = true;
+            continue;
+        }
+
+        pDrv->kernel(pDrv, x, dx, dt);
     }
+}
 
-    if (millis - LastTick > Period)
+void InsightBase::deriveDelta(Derived_t *pDrv, float x, float dx, float dt)
+{
+    (void) x;
+    (void) dt;
+    pDrv->out = dx;
+}
+
+void InsightBase::deriveRate(Derived_t *pDrv, float x, float dx, float dt)
+{
+    (void) x;
+    pDrv->out = (dt > 0) ? dx / dt : 0;
+}
+
+void InsightBase::deriveIntegral(Derived_t *pDrv, float x, float dx, float dt)
+{
+    (void) dx;
+    pDrv->out += x * dt;
+}
+
+void InsightBase::deriveEma(Derived_t *pDrv, float x, float dx, float dt)
+{
+    (void) dx;
+    (void) dt;
+    pDrv->out += pDrv->alpha * (x - pDrv->out);
+}
+
+bool InsightBase::addTimestamp(const char *name)
+{
+    if (Enabled || (StringsIdx == NumStrings))
     {
-        transmit();
-        LastTick = millis;
+        return false;
     }
+
+    return add(&FrameTime, dataType_uint_32, name) && 
+            addString('T', 0, name);
+}
+
+bool InsightBase::addPredictive(void *ptr, dataTypes_t type, const char *name, 
+        uint8_t order)
+{
+#if INSIGHT_NUMPREDICTIVE > 0
+    if (Enabled || (PredictiveIdx == INSIGHT_NUMPREDICTIVE) || (order > 3) ||
+        (type == dataType_uint_64) || (type == dataType_int_64) ||
+        (type == dataType_float) || (type == dataType_double))
+    {
+        return false;
+    }
+
+    if (!addString('R', PredictiveIdx, name))
+    {
+        return false;
+    }
+
+    Predictive[PredictiveIdx].ptr = ptr;
+    Predictive[PredictiveIdx].type = type;
+    Predictive[PredictiveIdx].order = order;
+    Predictive[PredictiveIdx].cnt = 0;
+    PredictiveIdx++;
+
+    return true;
+#else
+    (void) ptr;
+    (void) type;
+    (void) name;
+    (void) order;
+
+    return false;
+#endif
+}
+
+void InsightBase::transmitPredictive(void)
+{
+#if INSIGHT_NUMPREDICTIVE > 0
+    for (uint8_t i = 0; i < PredictiveIdx; i++)
+    {
+        uint32_t *pSmp = Predictive[i].samples;
+        uint8_t order = Predictive[i].order;
+        uint8_t cnt = Predictive[i].cnt;
+        const void *ptr = Predictive[i].ptr;
+
+        /* Sign extended to 32 bit, all math is done modulo 2^32. */
+        switch (Predictive[i].type)
+        {
+            case dataType_bool:     pSmp[cnt] = *(bool*)ptr;        break;
+            case dataType_uint_8:   pSmp[cnt] = *(uint8_t*)ptr;     break;
+            case dataType_uint_16:  pSmp[cnt] = *(uint16_t*)ptr;    break;
+            case dataType_uint_32:  pSmp[cnt] = *(uint32_t*)ptr;    break;
+            case dataType_int_8:    pSmp[cnt] = *(int8_t*)ptr;      break;
+            case dataType_int_16:   pSmp[cnt] = *(int16_t*)ptr;     break;
+            default:                pSmp[cnt] = *(int32_t*)ptr;     break;
+        }
+
+        if (++cnt < INSIGHT_RICEBLOCK)
+        {
+            Predictive[i].cnt = cnt;
+            continue;
+        }
+
+        Predictive[i].cnt = 0;
+
+        /* The residuals of the fixed polynomial predictors, zig zag encoded. 
+         * They replace the samples as those are not needed any longer, the 
+         * first ones are needed as warm up samples. */
+        for (uint8_t n = INSIGHT_RICEBLOCK - 1; n >= order; n--)
+        {
+            uint32_t res;
+
+            switch (order)
+            {
+                case 0:     res = pSmp[n];                              break;
+                case 1:     res = pSmp[n] - pSmp[n-1];                  break;
+                case 2:     res = pSmp[n] - 2*pSmp[n-1] + pSmp[n-2];    break;
+                default:    res = pSmp[n] - 3*pSmp[n-1] + 3*pSmp[n-2] - 
+                                    pSmp[n-3];                          break;
+            }
+
+            pSmp[n] = (res << 1) ^ (uint32_t)((int32_t) res >> 31);
+
+            if (n == 0)
+            {
+                break;
+            }
+        }
+
+        /* Pick the Rice parameter taking the least bits. The unary parts of 
+         * small parameters might take up to 2^32 bits per residual. */
+        uint8_t k = 0;
+        uint64_t best = UINT64_MAX;
+
+        for (uint8_t j = 0; j < 32; j++)
+        {
+            uint64_t bits = (uint64_t)(INSIGHT_RICEBLOCK - order) * (j + 1);
+
+            for (uint8_t n = order; n < INSIGHT_RICEBLOCK; n++)
+            {
+                bits += pSmp[n] >> j;
+            }
+
+            if (bits < best)
+            {
+                best = bits;
+                k = j;
+            }
+        }
+
+        uint8_t body[UINT8_MAX];
+        uint8_t idx = 0;
+
+        /* With k = 31 each residual takes 34 bits at most, so the best one 
+         * always fits, see INSIGHT_RICEBLOCK. Never write beyond the body 
+         * anyway. */
+        if (4 + order * sizeof(uint32_t) + (best + 7) / 8 > sizeof(body))
+        {
+            Dropped++;
+            continue;
+        }
+
+        body[idx++] = i;
+        body[idx++] = order;
+        body[idx++] = k;
+        body[idx++] = INSIGHT_RICEBLOCK;
+        memcpy(&body[idx], pSmp, order * sizeof(uint32_t));
+        idx += order * sizeof(uint32_t);
+        memset(&body[idx], 0, sizeof(body) - idx);
+
+        /* The bit stream, idx and bit tell the current bit position. */
+        uint8_t bit = 0;
+
+        for (uint8_t n = order; n < INSIGHT_RICEBLOCK; n++)
+        {
+            uint32_t q = pSmp[n] >> k;
+
+            /* q zeros are already there, followed by a one. */
+            bit += q % 8;
+            idx += q / 8 + bit / 8;
+            bit %= 8;
+
+            for (int8_t b = k; b >= 0; b--)
+            {
+                /* b == k writes the terminating one of the unary part. */
+                if ((b == k) || ((pSmp[n] >> b) & 1))
+                {
+                    body[idx] |= 0x80 >> bit;
+                }
+
+                if (++bit == 8)
+                {
+                    bit = 0;
+                    idx++;
+                }
+            }
+        }
+
+        queueBulk(ctrl.EM, body, idx + (bit != 0));
+    }
+#endif
+}
+
+bool InsightBase::addHistogram(void *ptr, dataTypes_t type, const char *name, 
+        float min, float max, bool logScale)
+{
+#if INSIGHT_NUMHISTOGRAMS > 0
+    if (Enabled || (HistogramIdx == INSIGHT_NUMHISTOGRAMS) || !(max > min) ||
+        (logScale && !(min > 0)))
+    {
+        return false;
+    }
+
+    if (!addString('H', HistogramIdx, name))
+    {
+        return false;
+    }
+
+    /* As sample() might be called at high rates the log scale bucket limits 
+     * are calculated here, so a binary search is all what it takes there. */
+    for (uint8_t i = 0; i < INSIGHT_HISTBUCKETS - 1; i++)
+    {
+        Histogram[HistogramIdx].edges[i] = min * 
+                powf(max / min, (float)(i + 1) / INSIGHT_HISTBUCKETS);
+    }
+
+    Histogram[HistogramIdx].ptr = ptr;
+    Histogram[HistogramIdx].type = type;
+    Histogram[HistogramIdx].log = logScale;
+    Histogram[HistogramIdx].min = min;
+    Histogram[HistogramIdx].max = max;
+    Histogram[HistogramIdx].scale = INSIGHT_HISTBUCKETS / (max - min);
+    HistogramIdx++;
+
+    return true;
+#else
+    (void) ptr;
+    (void) type;
+    (void) name;
+    (void) min;
+    (void) max;
+    (void) logScale;
+
+    return false;
+#endif
+}
+
+void InsightBase::sample(void)
+{
+    if (!Enabled || Pause)
+    {
+        return;
+    }
+
+#if INSIGHT_NUMHISTOGRAMS > 0
+    uint8_t bank = HistogramBank;
+
+    for (uint8_t i = 0; i < HistogramIdx; i++)
+    {
+        float x = toFloat(Histogram[i].ptr, Histogram[i].type);
+        uint8_t idx;
+
+        if (!(x > Histogram[i].min))
+        {
+            /* Also takes NaN */
+            idx = 0;
+        }
+        else if (Histogram[i].log)
+        {
+            uint8_t lo = 0, hi = INSIGHT_HISTBUCKETS - 1;
+
+            while (lo < hi)
+            {
+                uint8_t mid = (lo + hi) / 2;
+
+                if (x < Histogram[i].edges[mid])
+                {
+                    hi = mid;
+                }
+                else
+                {
+                    lo = mid + 1;
+                }
+            }
+
+            idx = lo;
+        }
+        else if (x < Histogram[i].max)
+        {
+            idx = (uint8_t)((x - Histogram[i].min) * Histogram[i].scale);
+            if (idx >= INSIGHT_HISTBUCKETS)
+            {
+                /* Rounding issues right below max. */
+                idx = INSIGHT_HISTBUCKETS - 1;
+            }
+        }
+        else
+        {
+            idx = INSIGHT_HISTBUCKETS - 1;
+        }
+
+        uint16_t *pBin = &Histogram[i].bins[bank][idx];
+        if (*pBin != UINT16_MAX)
+        {
+            (*pBin)++;
+        }
+    }
+#endif
+
+#if INSIGHT_NUMSPECTRA > 0
+    uint16_t pos = SpectrumPos;
+
+    for (uint8_t i = 0; i < SpectrumIdx; i++)
+    {
+        Spectrum[i].samples[pos] = toFloat(Spectrum[i].ptr, Spectrum[i].type);
+    }
+
+    SpectrumPos = (pos + 1) & (INSIGHT_SPECTRUMSIZ - 1);
+#endif
+}
+
+void InsightBase::transmitHistograms(void)
+{
+#if INSIGHT_NUMHISTOGRAMS > 0
+    uint8_t body[10 + INSIGHT_HISTBUCKETS*2];
+    uint8_t bank = HistogramBank;
+
+    if (HistogramIdx == 0)
+    {
+        return;
+    }
+
+    /* Let sample() continue with the other set of buckets while this one is 
+     * transmitted. */
+    HistogramBank = bank ^ 1;
+
+    for (uint8_t i = 0; i < HistogramIdx; i++)
+    {
+        uint8_t idx = 0;
+
+        body[idx++] = i;
+        body[idx++] = Histogram[i].log;
+        memcpy(&body[idx], &Histogram[i].min, sizeof(float));
+        idx += sizeof(float);
+        memcpy(&body[idx], &Histogram[i].max, sizeof(float));
+        idx += sizeof(float);
+        memcpy(&body[idx], Histogram[i].bins[bank], 
+                sizeof(Histogram[i].bins[bank]));
+        idx += sizeof(Histogram[i].bins[bank]);
+        memset(Histogram[i].bins[bank], 0, sizeof(Histogram[i].bins[bank]));
+
+        queueBulk(ctrl.DC3, body, idx);
+    }
+#endif
+}
+
+bool InsightBase::addSpectrum(void *ptr, dataTypes_t type, const char *name, 
+        bool window, uint8_t peaks)
+{
+#if INSIGHT_NUMSPECTRA > 0
+    /* All peaks have to fit into a single frame. */
+    if (Enabled || (SpectrumIdx == INSIGHT_NUMSPECTRA) || 
+        (peaks > INSIGHT_SPECTRUMSIZ/2) || (3 + peaks*6 > UINT8_MAX))
+    {
+        return false;
+    }
+
+    if (!addString('S', SpectrumIdx, name))
+    {
+        return false;
+    }
+
+    Spectrum[SpectrumIdx].ptr = ptr;
+    Spectrum[SpectrumIdx].type = type;
+    Spectrum[SpectrumIdx].window = window;
+    Spectrum[SpectrumIdx].peaks = peaks;
+    SpectrumIdx++;
+
+    return true;
+#else
+    (void) ptr;
+    (void) type;
+    (void) name;
+    (void) window;
+    (void) peaks;
+
+    return false;
+#endif
+}
+
+void InsightBase::transmitSpectra(void)
+{
+#if INSIGHT_NUMSPECTRA > 0
+    const uint16_t n = INSIGHT_SPECTRUMSIZ;
+    uint8_t body[UINT8_MAX];
+    uint16_t pos = SpectrumPos;
+
+    for (uint8_t i = 0; i < SpectrumIdx; i++)
+    {
+        uint8_t idx = 0;
+        float max = 0;
+
+        /* Get the sliding window in chronological order, sample() might add 
+         * new samples in the meantime. */
+        for (uint16_t k = 0; k < n; k++)
+        {
+            SpectrumRe[k] = Spectrum[i].samples[(pos + k) & (n - 1)];
+            SpectrumIm[k] = 0;
+
+            /* The Hann window halves the amplitude of a tone, which is 
+             * compensated by twice the window. */
+            if (Spectrum[i].window)
+            {
+                SpectrumRe[k] *= 1.0f - SpectrumCos[k <= n/2 ? k : n - k];
+            }
+        }
+
+        fft();
+
+        /* Single sided amplitudes, reusing the real part buffer. */
+        for (uint16_t k = 0; k < n/2; k++)
+        {
+            SpectrumRe[k] = sqrtf(SpectrumRe[k] * SpectrumRe[k] + 
+                    SpectrumIm[k] * SpectrumIm[k]) * (k == 0 ? 1.0f : 2.0f) / n;
+            
+            if (SpectrumRe[k] > max)
+            {
+                max = SpectrumRe[k];
+            }
+        }
+
+        body[idx++] = i;
+        body[idx] = 0;
+        for (uint16_t k = n; k > 1; k >>= 1)
+        {
+            body[idx]++;
+        }
+        idx++;
+        body[idx++] = Spectrum[i].peaks;
+
+        if (Spectrum[i].peaks == 0)
+        {
+            float scale = max / UINT16_MAX;
+
+            memcpy(&body[idx], &scale, sizeof(scale));
+            idx += sizeof(scale);
+
+            for (uint16_t k = 0; k < n/2; k++)
+            {
+                uint16_t mag = (scale > 0) ? 
+                        (uint16_t)(SpectrumRe[k] / scale + 0.5f) : 0;
+
+                memcpy(&body[idx], &mag, sizeof(mag));
+                idx += sizeof(mag);
+            }
+        }
+        else
+        {
+            /* A tone spreads over adjacent bins, especially if the window is 
+             * used, so only local maxima are peaks. They are flagged in the 
+             * imaginary part buffer which is not needed any longer. */
+            for (uint16_t k = 0; k < n/2; k++)
+            {
+                SpectrumIm[k] = 
+                    ((k == 0) || (SpectrumRe[k] >= SpectrumRe[k-1])) &&
+                    ((k == n/2 - 1) || (SpectrumRe[k] >= SpectrumRe[k+1]));
+            }
+
+            /* There might be less local maxima than peaks requested. */
+            body[2] = 0;
+
+            for (uint8_t p = 0; p < Spectrum[i].peaks; p++)
+            {
+                int16_t bin = -1;
+
+                for (uint16_t k = 0; k < n/2; k++)
+                {
+                    if ((SpectrumIm[k] != 0) && 
+                        ((bin < 0) || (SpectrumRe[k] > SpectrumRe[bin])))
+                    {
+                        bin = k;
+                    }
+                }
+
+                if (bin < 0)
+                {
+                    break;
+                }
+
+                /* Clear the flag, so the peak won't be found again. */
+                SpectrumIm[bin] = 0;
+
+                memcpy(&body[idx], &bin, sizeof(bin));
+                idx += sizeof(bin);
+                memcpy(&body[idx], &SpectrumRe[bin], sizeof(float));
+                idx += sizeof(float);
+                body[2]++;
+            }
+        }
+
+        queueBulk(ctrl.DC4, body, idx);
+    }
+#endif
+}
+
+#if INSIGHT_NUMSPECTRA > 0
+
+void InsightBase::fft(void)
+{
+    const uint16_t n = INSIGHT_SPECTRUMSIZ;
+
+    /* Iterative radix-2 decimation in time, starting with the bit reversal 
+     * permutation. */
+    for (uint16_t i = 1, j = 0; i < n; i++)
+    {
+        uint16_t bit = n >> 1;
+
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+
+        if (i < j)
+        {
+            float tmp = SpectrumRe[i];
+            SpectrumRe[i] = SpectrumRe[j];
+            SpectrumRe[j] = tmp;
+            tmp = SpectrumIm[i];
+            SpectrumIm[i] = SpectrumIm[j];
+            SpectrumIm[j] = tmp;
+        }
+    }
+
+    for (uint16_t len = 2; len <= n; len <<= 1)
+    {
+        uint16_t step = n / len;
+
+        for (uint16_t i = 0; i < n; i += len)
+        {
+            for (uint16_t k = 0; k < len/2; k++)
+            {
+                /* The twiddle factor exp(-2*pi*j*k*step/n), the sine is taken 
+                 * from the cosine table shifted by a quarter period. */
+                uint16_t t = k * step;
+                float wr = SpectrumCos[t];
+                float wi = -SpectrumCos[t < n/4 ? n/4 - t : t - n/4];
+                uint16_t a = i + k;
+                uint16_t b = a + len/2;
+                float re = SpectrumRe[b] * wr - SpectrumIm[b] * wi;
+                float im = SpectrumRe[b] * wi + SpectrumIm[b] * wr;
+
+                SpectrumRe[b] = SpectrumRe[a] - re;
+                SpectrumIm[b] = SpectrumIm[a] - im;
+                SpectrumRe[a] += re;
+                SpectrumIm[a] += im;
+            }
+        }
+    }
+}
+
+#endif
+
+float InsightBase::toFloat(const void *ptr, dataTypes_t type)
+{
+    switch (type)
+    {
+        case dataType_bool:     return *(bool*)ptr;
+        case dataType_uint_8:   return *(uint8_t*)ptr;
+        case dataType_uint_16:  return *(uint16_t*)ptr;
+        case dataType_uint_32:  return *(uint32_t*)ptr;
+        case dataType_uint_64:  return *(uint64_t*)ptr;
+        case dataType_int_8:    return *(int8_t*)ptr;
+        case dataType_int_16:   return *(int16_t*)ptr;
+        case dataType_int_32:   return *(int32_t*)ptr;
+        case dataType_int_64:   return *(int64_t*)ptr;
+        case dataType_float:    return *(float*)ptr;
+        default:                return *(double*)ptr;
+    }
+}
+
+bool InsightBase::addMarker(uint16_t id, const char *name)
+{
+    return addString('M', id, name);
+}
+
+bool InsightBase::mark(uint16_t id, const void *data, uint8_t len)
+{
+    if (!Enabled)
+    {
+        return false;
+    }
+
+    return Events.put(ctrl.DC1, &id, sizeof(id), data, len);
+}
+
+bool InsightBase::addLogFormat(uint16_t id, const char *fmt)
+{
+    return addString('F', id, fmt);
+}
+
+bool InsightBase::logFrame(const uint8_t *body, uint8_t len)
+{
+    if (!Enabled)
+    {
+        return false;
+    }
+
+    return Logs.put(ctrl.DC2, body, len);
+}
+
+bool InsightBase::addString(char tag, uint16_t id, const char *str)
+{
+    if (Enabled || (StringsIdx == NumStrings) || (str == 0))
+    {
+        return false;
+    }
+
+    Strings[StringsIdx].str = str;
+    Strings[StringsIdx].id = id;
+    Strings[StringsIdx].tag = tag;
+    StringsIdx++;
+
+    return true;
+}
+
+void InsightBase::flushEvents(void)
+{
+    InsightRing * const queues[] = {&Events, &Logs};
+    const uint8_t *pData;
+    uint16_t cnt;
+
+    for (uint8_t i = 0; i < sizeof(queues)/sizeof(queues[0]); i++)
+    {
+        /* At most two blocks as the data might wrap around. */
+        while ((cnt = queues[i]->peek(&pData)) != 0)
+        {
+            pStream->write(pData, cnt);
+            queues[i]->drop(cnt);
+        }
+    }
+}
+
+void InsightBase::queueBulk(uint8_t ctrlChar, const void *body1, uint8_t len1,
+        const void *body2, uint8_t len2)
+{
+    if (!Bulk.put(ctrlChar, body1, len1, body2, len2))
+    {
+        Dropped++;
+    }
+}
+
+void InsightBase::transmitSegment(void)
+{
+    uint8_t body[1 + INSIGHT_SEGMENTSIZ];
+    uint16_t cnt = Bulk.size();
+    uint16_t pos = BulkSkip;
+
+    if (cnt == 0)
+    {
+        return;
+    }
+
+    if (cnt > INSIGHT_SEGMENTSIZ)
+    {
+        cnt = INSIGHT_SEGMENTSIZ;
+    }
+
+    /* The offset of the first frame starting in this segment, so the host 
+     * can resume after a lost segment. Only complete frames are queued, so 
+     * the length of each frame starting in the segment is available. */
+    body[0] = (pos < cnt) ? pos : UINT8_MAX;
+
+    while (pos < cnt)
+    {
+        pos += 2 + Bulk.at(pos + 1);
+    }
+
+    BulkSkip = pos - cnt;
+
+    for (uint16_t i = 0; i < cnt; i++)
+    {
+        body[1 + i] = Bulk.at(i);
+    }
+
+    pStream->write(ctrl.SI);
+    pStream->write((uint8_t)(1 + cnt));
+    pStream->write(body, 1 + cnt);
+    Bulk.drop(cnt);
+}
+
+bool InsightBase::transmit(void)
+{
+    if (!transmitData())
+    {
+        return false;
+    }
+
+    /* There is no task(...) to transmit queued large frames segment by 
+     * segment, so they are sent right away. */
+    while (!Bulk.isEmpty())
+    {
+        transmitSegment();
+    }
+
+    return true;
+}
+
+bool InsightBase::transmitData(void)
+{
+    uint8_t buffer[INSIGHT_DATABUFFERSIZ];
+    uint8_t idx = 0;
+
+    if (!Enabled)
+    {
+        return false;
+    }
+
+    /* Events are transmitted between data frames. */
+    flushEvents();
+
+    updateDerived();
+
+    /* Data transmission shall be fast as possible. As consequence I have 
+     * decided to:
+     *
+     * # Don't use explicit frame termination as this will result in the need of
+     *   escaping control characters.
+     *
+     * # Use a buffer to collect the data and dont transmit each value on it's 
+     *   own. At least my measurements have shown that this is faster.
+     */
+#if INSIGHT_SEQUENCED
+    buffer[idx++] = ctrl.DLE;
+    buffer[idx++] = PayloadSize-1 + PadSize;
+    buffer[idx++] = Seq;
+#else
+    buffer[idx++] = ctrl.STX;
+    buffer[idx++] = PayloadSize-2 + PadSize;
+#endif
+
+    /* The sizes of the copy operations are known at compile time in most 
+     * cases, this allows to replace memcpy by a simple load and store. */
+    for (uint8_t i = 0; i < CopyOpsIdx; i++)
+    {
+        const uint8_t *src = CopyOps[i].src;
+        uint8_t siz = CopyOps[i].siz;
+
+        switch (siz)
+        {
+            case 1:     buffer[idx] = *src;                     break;
+            case 2:     memcpy(&buffer[idx], src, 2);           break;
+            case 4:     memcpy(&buffer[idx], src, 4);           break;
+            case 8:     memcpy(&buffer[idx], src, 8);           break;
+            default:    memcpy(&buffer[idx], src, siz);         break;
+        }
+
+        idx += siz;
+    }
+
+    memset(&buffer[idx], 0, PadSize);
+    idx += PadSize;
+
+#if INSIGHT_KEYFRAME > 0
+    if (FrameCnt != 0)
+    {
+        uint8_t out[INSIGHT_DATABUFFERSIZ];
+        uint8_t len = encode(&buffer[2], &out[2]);
+
+        memcpy(PrevFrame, &buffer[2], idx - 2);
+        out[0] = ctrl.SUB;
+        out[1] = len;
+        memcpy(buffer, out, len + 2);
+        idx = len + 2;
+    }
+    else
+    {
+        /* Key frame, select the encoding of the next frames based on the 
+         * statistics collected since the previous one. */
+        for (uint8_t i = 0; i < PayloadIdx; i++)
+        {
+            Payload[i].code = (Payload[i].delta < Payload[i].raw) ? 
+                    code_delta : code_raw;
+            Payload[i].raw = 0;
+            Payload[i].delta = 0;
+        }
+
+        memcpy(PrevFrame, &buffer[2], idx - 2);
+    }
+
+    FrameCnt = (FrameCnt + 1) % INSIGHT_KEYFRAME;
+#endif
+
+    pStream->write(buffer, idx);
+
+#if INSIGHT_ARQWINDOW > 0
+    /* Keep the frame for retransmission. If the slot is still in use the host
+     * has not acknowledged the oldest frame in time, it's dropped. */
+    uint8_t slot = Seq & (INSIGHT_ARQWINDOW - 1);
+    Window[slot].seq = Seq;
+    Window[slot].state = arqState_sent;
+    Window[slot].len = idx - 3;
+    Window[slot].next = Seq + 1;
+    memcpy(&WindowData[slot * FrameSiz], &buffer[3], idx - 3);
+#endif
+
+#if INSIGHT_FECBLOCK > 0
+    encodeFec(Seq, &buffer[3], idx - 3);
+#endif
+
+#if INSIGHT_SEQUENCED
+    Seq++;
+#endif
+
+    transmitHistograms();
+    transmitSpectra();
+    transmitPredictive();
+
+    return true;
+}
+
+#if INSIGHT_KEYFRAME > 0
+
+/**
+ * @brief Reads a integer of the given size from a unaligned address.
+ */
+static uint64_t loadRaw(const uint8_t *ptr, uint8_t siz)
+{
+    uint8_t u8;
+    uint16_t u16;
+    uint32_t u32;
+    uint64_t u64;
+
+    switch (siz)
+    {
+        case 1:     memcpy(&u8, ptr, 1);    return u8;
+        case 2:     memcpy(&u16, ptr, 2);   return u16;
+        case 4:     memcpy(&u32, ptr, 4);   return u32;
+        default:    memcpy(&u64, ptr, 8);   return u64;
+    }
+}
+
+uint8_t InsightBase::encode(const uint8_t *cur, uint8_t *out)
+{
+    uint8_t codes = (PayloadIdx + 3) / 4;
+    uint8_t pos = 0;
+    uint8_t idx = codes;
+
+    memset(out, 0, codes);
+
+    for (uint8_t i = 0; i < PayloadIdx; i++)
+    {
+        dataTypes_t type = Payload[i].type;
+        uint8_t siz = PayloadSpec[type].siz;
+        const uint8_t *pCur = &cur[pos];
+        const uint8_t *pPrev = &PrevFrame[pos];
+        uint8_t code = code_repeat;
+
+        pos += siz;
+
+        if (memcmp(pCur, pPrev, siz) == 0)
+        {
+            out[i / 4] |= code << ((i % 4) * 2);
+            continue;
+        }
+
+        /* The zig zag encoded difference calculated in the width of the 
+         * variable, floating point values are always raw. */
+        uint8_t varint[10];
+        uint8_t len = sizeof(varint);
+
+        if ((type != dataType_float) && (type != dataType_double))
+        {
+            uint64_t a = loadRaw(pCur, siz);
+            uint64_t b = loadRaw(pPrev, siz);
+            uint8_t shift = 64 - siz * 8;
+            int64_t diff = (int64_t)((a - b) << shift) >> shift;
+            uint64_t zz = ((uint64_t) diff << 1) ^ (uint64_t)(diff >> 63);
+
+            len = 0;
+            do
+            {
+                varint[len++] = (zz & 0x7f) | (zz > 0x7f ? 0x80 : 0);
+                zz >>= 7;
+            } 
+            while (zz != 0);
+        }
+
+        /* Statistics for the next key frame. */
+        Payload[i].raw += (Payload[i].raw <= UINT16_MAX - siz) ? siz : 0;
+        Payload[i].delta += (Payload[i].delta <= UINT16_MAX - len) ? len : 0;
+
+        if ((Payload[i].code == code_delta) && (len <= siz))
+        {
+            code = code_delta;
+            memcpy(&out[idx], varint, len);
+            idx += len;
+        }
+        else
+        {
+            code = code_raw;
+            memcpy(&out[idx], pCur, siz);
+            idx += siz;
+        }
+
+        out[i / 4] |= code << ((i % 4) * 2);
+    }
+
+    return idx;
+}
+
+#endif
+
+#if INSIGHT_FECBLOCK > 0
+
+void InsightBase::encodeFec(uint8_t seq, const uint8_t *data, uint8_t len)
+{
+    uint8_t k = Fec[FecIdx].cnt;
+
+    if (k == 0)
+    {
+        Fec[FecIdx].seq = seq;
+    }
+
+    /* Row zero uses the coefficient 1, so the first parity frame is the plain
+     * XOR of the data frames. The coefficients of the other rows are taken 
+     * from a Cauchy matrix 1/(x_j + y_k), x_j = K + j, y_k = k, scaled per 
+     * column to make row zero all ones. Scaling a column keeps every square 
+     * sub matrix regular, so any INSIGHT_FECPARITY lost frames of a block can 
+     * be recovered. */
+    for (uint8_t j = 0; j < INSIGHT_FECPARITY; j++)
+    {
+        uint8_t *pParity = &FecParity[(FecIdx * INSIGHT_FECPARITY + j) * 
+                (size_t) FrameSiz];
+
+        if (j == 0)
+        {
+            for (uint8_t i = 0; i < len; i++)
+            {
+                pParity[i] ^= data[i];
+            }
+
+            continue;
+        }
+
+        /* log(c) = log(x_0 + y_k) - log(x_j + y_k), addition is XOR */
+        uint16_t logc = GfLog[(uint8_t)(INSIGHT_FECBLOCK ^ k)] + 255 - 
+                GfLog[(uint8_t)((INSIGHT_FECBLOCK + j) ^ k)];
+        logc %= 255;
+
+        for (uint8_t i = 0; i < len; i++)
+        {
+            if (data[i] != 0)
+            {
+                pParity[i] ^= GfExp[logc + GfLog[data[i]]];
+            }
+        }
+    }
+
+    if (++k < INSIGHT_FECBLOCK)
+    {
+        Fec[FecIdx].cnt = k;
+    }
+    else
+    {
+        for (uint8_t j = 0; j < INSIGHT_FECPARITY; j++)
+        {
+            uint8_t hdr[2] = {Fec[FecIdx].seq, j};
+
+            queueBulk(ctrl.ETB, hdr, sizeof(hdr), 
+                    &FecParity[(FecIdx * INSIGHT_FECPARITY + j) * 
+                    (size_t) FrameSiz], len);
+        }
+
+        memset(&Fec[FecIdx], 0, sizeof(Fec[FecIdx]));
+        memset(&FecParity[FecIdx * INSIGHT_FECPARITY * (size_t) FrameSiz], 0, 
+                INSIGHT_FECPARITY * FrameSiz);
+    }
+
+    FecIdx = (FecIdx + 1) % INSIGHT_FECDEPTH;
+}
+
+#endif
+
+#if INSIGHT_ARQWINDOW > 0
+
+/**
+ * @brief Calculates the CRC-16/CCITT-FALSE of the given data, polynomial 
+ * 0x1021, initial value 0xffff.
+ */
+static uint16_t crc16(const uint8_t *data, uint8_t len)
+{
+    uint16_t crc = 0xffff;
+
+    for (uint8_t i = 0; i < len; i++)
+    {
+        crc ^= (uint16_t) data[i] << 8;
+
+        for (uint8_t b = 0; b < 8; b++)
+        {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+void InsightBase::receiveAck(void)
+{
+    /* A acknowledge is made of ACK, the sequence number of the first frame not
+     * received yet, a bitmap as 32 bit little endian value and the CRC-16 of 
+     * the sequence number and the bitmap, little endian as well. Bit n is set 
+     * if the frame with sequence number base + n has been received. */
+    while (pStream->available() > 0)
+    {
+        int c = pStream->read();
+
+        if ((c < 0) || ((AckBufferPos == 0) && (c != ctrl.ACK)))
+        {
+            continue;
+        }
+
+        AckBuffer[AckBufferPos++] = c;
+        if (AckBufferPos < sizeof(AckBuffer))
+        {
+            continue;
+        }
+
+        uint16_t crc = crc16(&AckBuffer[1], sizeof(AckBuffer) - 3);
+
+        /* The host can't acknowledge frames which have not been sent yet. */
+        if ((AckBuffer[6] != (uint8_t) crc) || 
+            (AckBuffer[7] != (uint8_t)(crc >> 8)) ||
+            ((uint8_t)(AckBuffer[1] - Seq - 1) < 127))
+        {
+            /* Corrupted or not aligned to the start of a acknowledge, e.g. 
+             * due to a lost byte. Start over at the next ACK received. */
+            uint8_t i = 1;
+
+            while ((i < sizeof(AckBuffer)) && (AckBuffer[i] != ctrl.ACK))
+            {
+                i++;
+            }
+
+            AckBufferPos = sizeof(AckBuffer) - i;
+            memmove(AckBuffer, &AckBuffer[i], AckBufferPos);
+            continue;
+        }
+
+        AckBufferPos = 0;
+        
+        uint8_t base = AckBuffer[1];
+        uint32_t bitmap = (uint32_t) AckBuffer[2] | 
+                ((uint32_t) AckBuffer[3] << 8) | 
+                ((uint32_t) AckBuffer[4] << 16) | 
+                ((uint32_t) AckBuffer[5] << 24);
+
+        for (uint8_t i = 0; i < INSIGHT_ARQWINDOW; i++)
+        {
+            uint8_t dist = Window[i].seq - base;
+            uint8_t next = Window[i].next - base;
+
+            if (Window[i].state == arqState_free)
+            {
+                continue;
+            }
+
+            if (dist >= 128)
+            {
+                /* Older than base, received. */
+                Window[i].state = arqState_free;
+            }
+            else if (dist < 32)
+            {
+                if (bitmap & ((uint32_t) 1 << dist))
+                {
+                    Window[i].state = arqState_free;
+                }
+                else if ((next < 32) && (bitmap >> next))
+                {
+                    /* A frame sent after the last transmission of this one 
+                     * has been received, so this one is lost and not just on 
+                     * it's way. Acknowledges sent before a retransmission 
+                     * could arrive don't cause another one. */
+                    Window[i].state = arqState_lost;
+                }
+            }
+        }
+    }
+}
+
+void InsightBase::retransmit(void)
+{
+    int16_t oldest = -1;
+
+    for (uint8_t i = 0; i < INSIGHT_ARQWINDOW; i++)
+    {
+        if ((Window[i].state == arqState_lost) && ((oldest < 0) ||
+            ((int8_t)(Window[i].seq - Window[oldest].seq) < 0)))
+        {
+            oldest = i;
+        }
+    }
+
+    if (oldest < 0)
+    {
+        return;
+    }
+
+    /* If there is no space left try again next time. */
+    if (Bulk.put(ctrl.DLE, &Window[oldest].seq, 1, 
+            &WindowData[oldest * FrameSiz], Window[oldest].len))
+    {
+        Window[oldest].state = arqState_sent;
+        Window[oldest].next = Seq;
+    }
+}
+
+#endif
+
+void InsightBase::task(uint32_t millis)
+{
+    if (!Enabled)
+    {
+        return;
+    }
+
+#if INSIGHT_ARQWINDOW > 0
+    receiveAck();
+#endif
+
+    if (Pause)
+    {
+        return;
+    }
+
+#if INSIGHT_ARQWINDOW > 0
+    retransmit();
+#endif
+
+    /* Highest priority first, see the header for details. */
+    flushEvents();
+
+    if (millis - LastTick > Period)
+    {
+        FrameTime = millis;
+        transmitData();
+        LastTick = millis;
+    }
+
+    transmitSegment();
 }
\ No newline at end of file
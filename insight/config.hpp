@@ -37,6 +37,153 @@
 #define INSIGHT_NAMEBUFFERSIZ       32
 #endif
 
+#ifndef INSIGHT_EVENTBUFFERSIZ
+/**
+ * @brief Defines the default size of the buffer queueing event frames like 
+ * markers until they get transmitted, see InsightSized. Has to be a power of 
+ * two.
+ */
+#define INSIGHT_EVENTBUFFERSIZ      32
+#endif
+
+#ifndef INSIGHT_LOGBUFFERSIZ
+/**
+ * @brief Defines the default size of the buffer queueing log messages until 
+ * they get transmitted, see InsightSized. Has to be a power of two.
+ */
+#define INSIGHT_LOGBUFFERSIZ        32
+#endif
+
+#ifndef INSIGHT_SEGMENTSIZ
+/**
+ * @brief Defines the max number of queued large frame bytes transmitted per 
+ * call of the task function, 254 at most.
+ */
+#define INSIGHT_SEGMENTSIZ          32
+#endif
+
+#ifndef INSIGHT_NUMDERIVED
+/**
+ * @brief Defines the default number of derived values which can be added to a
+ * stream, see InsightSized.
+ */
+#define INSIGHT_NUMDERIVED          0
+#endif
+
+#ifndef INSIGHT_NUMHISTOGRAMS
+/**
+ * @brief Defines the number of histograms which can be added to a stream. Zero
+ * disables this feature.
+ */
+#define INSIGHT_NUMHISTOGRAMS       0
+#endif
+
+#ifndef INSIGHT_HISTBUCKETS
+/**
+ * @brief Defines the number of buckets per histogram.
+ */
+#define INSIGHT_HISTBUCKETS         16
+#endif
+
+#ifndef INSIGHT_NUMSPECTRA
+/**
+ * @brief Defines the number of spectra which can be added to a stream. Zero 
+ * disables this feature as each spectrum takes INSIGHT_SPECTRUMSIZ floats.
+ */
+#define INSIGHT_NUMSPECTRA          0
+#endif
+
+#ifndef INSIGHT_SPECTRUMSIZ
+/**
+ * @brief Defines the number of samples used to compute a spectrum. Has to be a 
+ * power of two, a spectrum provides half as many frequency bins.
+ */
+#define INSIGHT_SPECTRUMSIZ         64
+#endif
+
+#ifndef INSIGHT_ARQWINDOW
+/**
+ * @brief Defines the number of data frames kept for retransmission. Zero 
+ * disables reliable streaming. Has to be a power of two, 32 at most.
+ */
+#define INSIGHT_ARQWINDOW           0
+#endif
+
+#ifndef INSIGHT_FECBLOCK
+/**
+ * @brief Defines the number of data frames protected by forward error 
+ * correction as one block. Zero disables forward error correction.
+ */
+#define INSIGHT_FECBLOCK            0
+#endif
+
+#ifndef INSIGHT_FECPARITY
+/**
+ * @brief Defines the number of parity frames sent per block, this is the 
+ * number of lost frames per block the host is able to recover. 
+ */
+#define INSIGHT_FECPARITY           1
+#endif
+
+#ifndef INSIGHT_FECDEPTH
+/**
+ * @brief Defines the number of interleaved blocks. Consecutive data frames 
+ * belong to different blocks, so a burst of up to INSIGHT_FECDEPTH lost frames 
+ * costs just one frame per block. INSIGHT_FECBLOCK * INSIGHT_FECDEPTH must not 
+ * exceed 256 as frames are identified by a 8 bit sequence number.
+ */
+#define INSIGHT_FECDEPTH            1
+#endif
+
+#ifndef INSIGHT_KEYFRAME
+/**
+ * @brief Defines the interval of key frames if data frames shall be encoded 
+ * adaptively. Zero disables the encoding.
+ */
+#define INSIGHT_KEYFRAME            0
+#endif
+
+#ifndef INSIGHT_NUMPREDICTIVE
+/**
+ * @brief Defines the number of predictive coded values which can be added to a 
+ * stream. Zero disables this feature.
+ */
+#define INSIGHT_NUMPREDICTIVE       0
+#endif
+
+#ifndef INSIGHT_RICEBLOCK
+/**
+ * @brief Defines the number of samples of a predictive coded value which are 
+ * transmitted in one frame.
+ */
+#define INSIGHT_RICEBLOCK           32
+#endif
+
+#ifndef INSIGHT_BULKBUFFERSIZ
+/**
+ * @brief Defines the default size of the buffer queueing large frames like 
+ * histograms and spectra until they get transmitted, see InsightSized. Has to 
+ * be a power of two. Zero unless a feature producing large frames is enabled.
+ */
+#if INSIGHT_NUMHISTOGRAMS > 0 || INSIGHT_NUMSPECTRA > 0 || \
+    INSIGHT_NUMPREDICTIVE > 0 || INSIGHT_ARQWINDOW > 0 || INSIGHT_FECBLOCK > 0
+#define INSIGHT_BULKBUFFERSIZ       256
+#else
+#define INSIGHT_BULKBUFFERSIZ       0
+#endif
+#endif
+
+#ifndef INSIGHT_NUMSTRINGS
+/**
+ * @brief Defines the default number of entries in the string table 
+ * transmitted in the header, see InsightSized. Histograms, spectra and 
+ * predictive coded values take one entry each, two more are left for e.g. the 
+ * names of markers, log formats or the time stamp.
+ */
+#define INSIGHT_NUMSTRINGS          (INSIGHT_NUMHISTOGRAMS + INSIGHT_NUMSPECTRA + \
+                                    INSIGHT_NUMPREDICTIVE + 2)
+#endif
+
 #ifndef INSIGHT_BINARYINFO_FMT
 
 /**
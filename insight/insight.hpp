@@ -24,6 +24,8 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
+#include <type_traits>
 #include <Arduino.h>
 
 #if __has_include ("insight_config.hpp")
@@ -31,6 +33,21 @@
 #endif
 
 #include "insight/config.hpp"
+#include "insight/ring.hpp"
+
+/**
+ * @brief Data frames carry a sequence number if the host has to know about 
+ * lost frames.
+ */
+#define INSIGHT_SEQUENCED           (INSIGHT_ARQWINDOW > 0 || INSIGHT_FECBLOCK > 0)
+
+/**
+ * @brief The number of data frames kept by retransmission, forward error 
+ * correction and the encoding.
+ */
+#define INSIGHT_NUMFRAMEBUFFERS     (INSIGHT_ARQWINDOW + \
+            (INSIGHT_FECBLOCK > 0 ? INSIGHT_FECDEPTH*INSIGHT_FECPARITY : 0) + \
+            (INSIGHT_KEYFRAME > 0 ? 1 : 0))
 
 /**
  * @brief This enum is used to define data types. The interger values 
@@ -52,14 +69,130 @@ typedef enum {
 
 }dataTypes_t; 
 
-class Insight
+/**
+ * @brief This enum is used to define the kind of a derived value. The interger
+ * values are used to access const data arrays defined by the implementation.
+ */
+typedef enum {
+
+    derived_delta    = 0,   /** Difference to the previous frame */
+    derived_rate     = 1,   /** Difference per second */
+    derived_integral = 2,   /** Running integral, value times seconds */
+    derived_ema      = 3    /** Exponential moving average */
+
+}derivedTypes_t;
+
+/**
+ * @brief The implementation of the data stream.
+ * 
+ * This class does not own the storage of the variables and their names, see 
+ * InsightSized below for a class providing it. Use the Insight typedef if the
+ * default capacities defined by config.hpp are what you want.
+ */
+class InsightBase
 {
     public:
+
+        /**
+         * @brief The data needed per variable for transmitting data.
+         */
+        typedef struct {
+            
+            void            *ptr;   /** The point tot the data */
+            dataTypes_t     type;   /** The type of the data */
+            uint8_t         name;   /** The offset of the name */
+#if INSIGHT_KEYFRAME > 0
+            uint8_t         code;   /** The encoding, see INSIGHT_KEYFRAME */
+            uint16_t        raw;    /** Bytes needed by raw encoding */
+            uint16_t        delta;  /** Bytes needed by delta encoding */
+#endif
+
+        } Payload_t;
+
+        /**
+         * @brief A single copy operation used to collect the data, see 
+         * compile().
+         */
+        typedef struct {
+
+            const uint8_t   *src;   /** The data to copy */
+            uint8_t         siz;    /** The number of bytes to copy */
+
+        } CopyOp_t;
+
+        /**
+         * @brief The state of a derived value, see addDerived(...).
+         */
+        struct Derived_t {
+
+            /** The function computing the value */
+            void            (*kernel)(Derived_t *pDrv, float x, float dx, 
+                                float dt);
+            void            *src;   /** The source variable */
+            dataTypes_t     type;   /** The type of the source */
+            bool            valid;  /** False until the first frame */
+            float           alpha;  /** The EMA weight */
+            float           out;    /** The transmitted value */
+
+            union {
+                int64_t     i;      /** The previous integer value */
+                double      d;      /** The previous floating point value */
+            } prev;
+
+        };
+
+        /**
+         * @brief A entry of the string table transmitted in the header in 
+         * addition to the variable names, e.g. the name of a marker.
+         */
+        typedef struct {
+
+            const char      *str;   /** The string provided by the user */
+            uint16_t        id;     /** The id the string belongs to */
+            char            tag;    /** The kind of string, e.g. 'M'arker */
+
+        } String_t;
+
+        /**
+         * @brief The external storage of a data stream, see InsightSized.
+         */
+        typedef struct {
+
+            Payload_t       *payload;   /** The variables */
+            CopyOp_t        *copyOps;   /** The copy operations */
+            uint8_t         numValues;  /** The size of both above */
+            uint8_t         *names;     /** The variable names */
+            uint8_t         namesSiz;   /** The size of the name buffer */
+            uint8_t         *events;    /** The event queue */
+            uint16_t        eventsSiz;  /** The size of the event queue */
+            uint8_t         *logs;      /** The log message queue */
+            uint16_t        logsSiz;    /** The size of the log queue */
+            uint8_t         *bulk;      /** The large frame queue */
+            uint16_t        bulkSiz;    /** The size of the large frame queue */
+            String_t        *strings;   /** The string table */
+            uint8_t         numStrings; /** The size of the string table */
+            Derived_t       *derived;   /** The derived values */
+            uint8_t         numDerived; /** The number of derived values */
+
+            /** INSIGHT_NUMFRAMEBUFFERS buffers of frameSiz bytes */
+            uint8_t         *frames;
+            uint8_t         frameSiz;   /** The max payload of a data frame */
+
+        } Storage_t;
     
         /**
-         * @brief Construct a new Insight object
+         * @brief Construct a new Insight object using external storage.
+         * 
+         * @param storage The storage to use.
          */
-        Insight();
+        InsightBase(const Storage_t &storage);
+
+        /**
+         * @brief Streams can't be copied as they point into the storage of the
+         * original, see InsightSized.
+         */
+        InsightBase(const InsightBase &) = delete;
+        InsightBase &operator=(const InsightBase &) = delete;
 
         /**
          * @brief Rests stream related data.
@@ -89,6 +222,24 @@ class Insight
          */
         void setPeriod(uint32_t millis);
 
+        /**
+         * @brief Used to select the layout of data frames.
+         * 
+         * By default variables are transmitted in the order they have been 
+         * added. If the aligned layout is selected, enable(...) sorts them by 
+         * size, largest first, and appends zero bytes to make the payload a 
+         * multiple of the largest size. Hence, every value is naturally 
+         * aligned relative to the start of the payload and the host can map 
+         * the payload of consecutive frames directly to an array of structs. 
+         * The header lists the variables in the order they are transmitted and
+         * tells the number of padding bytes by the 'P' entry.
+         * 
+         * Takes effect with the next call of enable(true). 
+         * 
+         * @param state True to select the aligned layout.
+         */
+        void setAligned(bool state);
+
         /**
          * @brief Tells the currently configured insight task period
          * 
@@ -96,6 +247,15 @@ class Insight
          */
         uint32_t getPeriod(void);
 
+        /**
+         * @brief Tells the number of large frames like histograms, spectra or 
+         * parity frames dropped since the last call of enable(true), as there 
+         * was not enough space left in the queue, see INSIGHT_BULKBUFFERSIZ.
+         * 
+         * @return The number of dropped frames.
+         */
+        uint32_t getDropped(void);
+
         /**
          * @brief Used to enable or disable the data transmission.
          * 
@@ -316,12 +476,288 @@ class Insight
          */
         bool add(void *ptr, dataTypes_t type, const char *name);
 
+        /**
+         * @brief Used to add a value derived from a variable to the data stream.
+         * 
+         * Derived values are computed by transmit(...) right before the data 
+         * is collected, so they cost nothing as long as data transmission is 
+         * disabled or paused. They are transmitted as float.
+         * 
+         * Rates and integrals are based on the time handed over to task(...), 
+         * so they can't be used when calling transmit(...) on your own. The 
+         * first frame after enable(...) transmits a rate and integral of 0.
+         * 
+         * @param src Pointer to the variable, which has to be added before by 
+         *            add(...). Might also be a previously added derived value.
+         * @param kind The kind of the derived value.
+         * @param name A string to identify the value later on.
+         * @param alpha The weight of the new value in case of derived_ema, 
+         *              ignored otherwise.
+         *
+         * @return true if it has been added successfully.
+         * @return false if can't be added. Either because data transmission is 
+         *         enabled, the source or kind is unknown or the internal data 
+         *         structures can't take more data.
+         */
+        bool addDerived(void *src, derivedTypes_t kind, const char *name, 
+                float alpha=0.1f);
+
+        /**
+         * @brief Used to add the capture time of each frame to the stream.
+         * 
+         * The capture time is the time handed over to task(...) when the frame
+         * was collected, transmitted as uint32_t. So it can't be used when 
+         * calling transmit(...) on your own. The host can relate it to the 
+         * time of reception to measure the latency. The name is also listed by 
+         * the 'T' entry of the header to tell the host which variable to use.
+         * 
+         * @param name A string to identify the time stamp later on.
+         *
+         * @return true if it has been added successfully.
+         * @return false if can't be added. Either because data transmission is 
+         *         enabled or the internal data structures can't take more data.
+         */
+        bool addTimestamp(const char *name);
+
+        /**
+         * @brief Used to add a predictive coded integer variable.
+         * 
+         * Instead of being part of each data frame, the value is sampled by 
+         * transmit() and INSIGHT_RICEBLOCK samples are transmitted at once. 
+         * The samples are predicted by a fixed polynomial of the given order, 
+         * like FLAC does, and the residuals are Rice coded. This takes just a 
+         * few bits per sample for smooth signals like temperatures or 
+         * positions.
+         * 
+         * The frame is made of the index, the order, the Rice parameter k, the
+         * number of samples, the first order samples as int32_t and the bit 
+         * stream, most significant bit first. Each residual is zig zag 
+         * encoded and given by (value >> k) zero bits, a one bit and the 
+         * lower k bits of the value. Prediction and residuals are calculated 
+         * modulo 2^32. Each frame can be decoded on it's own. The name is 
+         * transmitted in the header.
+         * 
+         * Only available if INSIGHT_NUMPREDICTIVE is not zero.
+         * 
+         * @param ptr Pointer to the variable.
+         * @param type The type of the variable, integers up to 32 bit.
+         * @param name A string to identify the value later on. Only the 
+         *             pointer is stored, so the string has to stay valid, 
+         *             string literals are fine. Semicolons are not allowed.
+         * @param order The order of the predictor, 0 to 3.
+         *
+         * @return true if it has been added successfully.
+         * @return false if can't be added. Either because data transmission is 
+         *         enabled, the type or order is not supported or the internal 
+         *         data structures can't take more data.
+         */
+        bool addPredictive(void *ptr, dataTypes_t type, const char *name, 
+                uint8_t order);
+
+        /**
+         * @brief Used to add a histogram of a variable to the data stream.
+         * 
+         * Instead of the value itself it's distribution is transmitted. Each 
+         * call of sample() adds the current value to one of 
+         * INSIGHT_HISTBUCKETS buckets, transmit() sends the histogram once 
+         * per frame and starts over. Values out of range are counted in the 
+         * first or the last bucket. Counters saturate at UINT16_MAX.
+         * 
+         * The histogram frame is made of the histogram index, a flag telling 
+         * if log scale is used, min and max as float followed by the buckets 
+         * as uint16_t. The name is transmitted in the header.
+         * 
+         * Only available if INSIGHT_NUMHISTOGRAMS is not zero.
+         * 
+         * @param ptr Pointer to the variable.
+         * @param type The type of the variable.
+         * @param name A string to identify the histogram later on. Only the 
+         *             pointer is stored, so the string has to stay valid, 
+         *             string literals are fine. Semicolons are not allowed.
+         * @param min The lower limit of the first bucket.
+         * @param max The upper limit of the last bucket.
+         * @param logScale If true the buckets are spaced logarithmically, 
+         *                 which requires min to be larger than zero.
+         *
+         * @return true if it has been added successfully.
+         * @return false if can't be added. Either because data transmission is 
+         *         enabled, the limits are invalid or the internal data 
+         *         structures can't take more data.
+         */
+        bool addHistogram(void *ptr, dataTypes_t type, const char *name, 
+                float min, float max, bool logScale=false);
+
+        /**
+         * @brief Used to add the spectrum of a variable to the data stream.
+         * 
+         * Each call of sample() adds the current value to a sliding window of 
+         * the last INSIGHT_SPECTRUMSIZ samples. transmit() computes the 
+         * spectrum of the window once per frame, so the sample() calls should 
+         * be equally spaced in time.
+         * 
+         * The spectrum frame is made of the spectrum index, the number of 
+         * samples as power of two, the number of peaks and the bins. In case 
+         * of all bins, a float scale is followed by the magnitudes as 
+         * uint16_t, a magnitude is the uint16_t value times the scale. In case
+         * of peaks, each peak is given by it's bin number as uint16_t and it's 
+         * magnitude as float, sorted by magnitude. Peaks are local maxima, so 
+         * the number of peaks transmitted might be less than requested. The 
+         * name is transmitted in the header.
+         * 
+         * Only available if INSIGHT_NUMSPECTRA is not zero.
+         * 
+         * @param ptr Pointer to the variable.
+         * @param type The type of the variable.
+         * @param name A string to identify the spectrum later on. Only the 
+         *             pointer is stored, so the string has to stay valid, 
+         *             string literals are fine. Semicolons are not allowed.
+         * @param window If true a Hann window is applied to the samples. The
+         *               magnitudes are corrected for the window, so a tone 
+         *               reads the same amplitude either way.
+         * @param peaks Zero to transmit all bins, otherwise only the given 
+         *              number of local maxima with the largest magnitude is 
+         *              sent.
+         *
+         * @return true if it has been added successfully.
+         * @return false if can't be added. Either because data transmission is 
+         *         enabled or the internal data structures can't take more data.
+         */
+        bool addSpectrum(void *ptr, dataTypes_t type, const char *name, 
+                bool window=true, uint8_t peaks=0);
+
+        /**
+         * @brief Samples all histograms and spectra.
+         * 
+         * Call this as often as you want the histograms and spectra to be 
+         * updated, e.g. in a fast timer interrupt. It must not be called from different 
+         * interrupts which might preempt each other. Does nothing if data 
+         * transmission is disabled or paused.
+         */
+        void sample(void);
+
+        /**
+         * @brief Used to add a name for a marker id to the header.
+         * 
+         * Markers can be used without a name, the name is just a hint for the 
+         * host to know what a particular marker id means.
+         * 
+         * @param id The marker id, see mark(...).
+         * @param name The name of the marker. Only the pointer is stored, so 
+         *             the string has to stay valid, string literals are fine.
+         *             Semicolons are not allowed.
+         *
+         * @return true if it has been added successfully.
+         * @return false if can't be added. Either because data transmission is 
+         *         enabled or the string table is full.
+         */
+        bool addMarker(uint16_t id, const char *name);
+
+        /**
+         * @brief Used to put a marker into the data stream.
+         * 
+         * Markers are queued and transmitted in front of the next data frame, 
+         * so they cost nothing as long as they are not used. The marker frame 
+         * is made of the id followed by the optional payload.
+         * 
+         * This function is lock free and can be called from a interrupt. As 
+         * the event queue takes a single producer, markers have to be put from
+         * one execution context only: either from the main loop or from a 
+         * single interrupt, never from both.
+         * 
+         * @param id The marker id, e.g. the number of a test step.
+         * @param data Optional payload to add to the marker, might be NULL.
+         * @param len The size of the payload.
+         * 
+         * @return true in case of success.
+         * @return false if data transmission is not enabled or if there is no 
+         *         space left in the event buffer.
+         */
+        bool mark(uint16_t id, const void *data=0, uint8_t len=0);
+
+        /**
+         * @brief Used to add a log format string to the header.
+         * 
+         * @param id The id used when calling log(...).
+         * @param fmt The printf style format string used by the host to format
+         *            the arguments of log(...). Only the pointer is stored, so 
+         *            the string has to stay valid, string literals are fine.
+         *            Semicolons are not allowed.
+         *
+         * @return true if it has been added successfully.
+         * @return false if can't be added. Either because data transmission is 
+         *         enabled or the string table is full.
+         */
+        bool addLogFormat(uint16_t id, const char *fmt);
+
+        /**
+         * @brief Used to put a log message into the data stream.
+         * 
+         * Formatting is up to the host, only the id of the format string and 
+         * the raw arguments are transmitted. Each argument is preceded by its 
+         * data type, see dataTypes_t. So logging costs about the same as a 
+         * memcpy of the arguments. Only arithmetic types are supported, 
+         * strings can't be logged this way.
+         * 
+         * Log messages are queued like markers, but have their own queue. So
+         * log(...) and mark(...) might be called from different execution 
+         * contexts, e.g. logging from the main loop while a interrupt puts 
+         * markers. Log messages have to be put from one execution context 
+         * only, just like markers. Queued markers are transmitted in front of
+         * queued log messages.
+         * 
+         * @param id The id of the format string, see addLogFormat(...).
+         * @param args The arguments.
+         * 
+         * @return true in case of success.
+         * @return false if data transmission is not enabled or if there is no 
+         *         space left in the log buffer.
+         */
+        template<typename... Args>
+        bool log(uint16_t id, Args... args)
+        {
+            uint8_t body[sizeof(id) + LogSize<Args...>::value];
+
+            static_assert(sizeof(body) <= UINT8_MAX, "Too many log arguments");
+
+            memcpy(&body[0], &id, sizeof(id));
+            logPack(&body[sizeof(id)], args...);
+
+            return logFrame(body, sizeof(body));
+        }
+
         /**
          * @brief Used to collect the data added to the data transmission and 
          * transmitt a single frame to the host. 
          * 
-         * This function is called by the task(...) function with the configured 
-         * period.
+         * Use this function if you don't want to use the task(...) function. 
+         * Large frames like histograms are transmitted right away after the 
+         * data frame, as segment frames like task(...) does. The task(...) 
+         * function does not call this function, it sends the data frame only 
+         * and spreads large frames over it's calls.
+         * 
+         * If INSIGHT_ARQWINDOW or INSIGHT_FECBLOCK is not zero, data frames 
+         * carry a 8 bit sequence number. With INSIGHT_FECBLOCK, each 
+         * INSIGHT_FECBLOCK data frames of a block are followed by 
+         * INSIGHT_FECPARITY parity frames, made of the sequence number of the 
+         * first data frame of the block, the parity index and the parity 
+         * data. The first parity frame is the XOR of all data frames, the 
+         * others use Cauchy Reed-Solomon coefficients over GF(256). Only 
+         * erasures, i.e. lost frames, can be recovered. Frames carry no 
+         * checksum, so corrupted frames have to be detected by the link, e.g.
+         * UDP, otherwise they can't be repaired.
+         * 
+         * If INSIGHT_KEYFRAME is not zero, only every INSIGHT_KEYFRAME'th 
+         * frame is a regular data frame, called key frame. The others are 
+         * encoded relative to the previous frame. An encoded frame starts 
+         * with a 2 bit code per variable in transmission order, four per 
+         * byte starting at the least significant bits, followed by the 
+         * variables. Code 0 is the raw value, 1 the difference to the previous
+         * value as zig zag encoded LEB128 varint, 2 means the value has not 
+         * changed and nothing is sent. At each key frame the encoding of 
+         * each integer variable is set to raw or difference depending on the 
+         * number of bytes both would have taken since the last key frame. 
+         * Padding is not part of encoded frames. Can't be combined with 
+         * INSIGHT_ARQWINDOW or INSIGHT_FECBLOCK.
          * 
          * @return true in case of success. 
          * @return false if the transmission has not been enabled before. 
@@ -334,12 +770,102 @@ class Insight
          * Call this in your main loop as fast as possible, it will transmit 
          * data on it's own in the set interval. See setPeriod(...)
          * 
+         * Frames are scheduled by priority. Each call transmits all queued 
+         * events like markers and log messages first, followed by the data 
+         * frame if it is due. Finally, at most INSIGHT_SEGMENTSIZ bytes of 
+         * large frames like histograms, spectra, parity frames and 
+         * retransmissions are sent as segment frame. The body of a segment 
+         * frame is made of the offset of the first frame starting in the 
+         * segment, 255 if there is none, followed by the data. The host has 
+         * to concatenate the data of all segment frames, the result is a 
+         * stream of regular frames. After a lost segment the host drops the 
+         * data until the next segment telling the start of a frame. So a 
+         * large frame delays urgent frames by one segment at most.
+         * 
+         * If INSIGHT_ARQWINDOW is not zero data frames are kept for 
+         * retransmission. In this case this function reads acknowledges 
+         * sent by the host from the stream and queues at most one lost frame 
+         * per call for retransmission. Hence, the stream must not be read by 
+         * anyone else. Acknowledges are protected by a CRC-16, corrupted ones 
+         * are ignored.
+         * 
          * @param millis The current wall clock in ms.
          */
         void task(uint32_t millis);
 
     private:
 
+        /**
+         * @brief Tells the number of bytes needed to log the given types.
+         */
+        template<typename... T> 
+        struct LogSize
+        {
+            static const size_t value = 0;
+        };
+
+        template<typename T, typename... R> 
+        struct LogSize<T, R...>
+        {
+            static const size_t value = 1 + sizeof(T) + LogSize<R...>::value;
+        };
+
+        /**
+         * @brief Tells the data type of a log argument.
+         * 
+         * Integers are mapped by their size as e.g. int and int32_t might be 
+         * distinct types.
+         */
+        template<typename T>
+        static dataTypes_t logType(T)
+        {
+            const bool sgn = ((T) -1) < ((T) 0);
+
+            static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                    "Only arithmetic types can be logged");
+            static_assert(sizeof(T) == 1 || sizeof(T) == 2 || 
+                    sizeof(T) == 4 || sizeof(T) == 8, "Unsupported log type");
+
+            switch (sizeof(T))
+            {
+                case 1:     return sgn ? dataType_int_8  : dataType_uint_8;
+                case 2:     return sgn ? dataType_int_16 : dataType_uint_16;
+                case 4:     return sgn ? dataType_int_32 : dataType_uint_32;
+                default:    return sgn ? dataType_int_64 : dataType_uint_64;
+            }
+        }
+
+        static dataTypes_t logType(bool)    { return dataType_bool; }
+        static dataTypes_t logType(float)   { return dataType_float; }
+        static dataTypes_t logType(double)  { return dataType_double; }
+
+        /**
+         * @brief Writes the log arguments to the given buffer.
+         */
+        static void logPack(uint8_t *pos)
+        {
+            (void) pos;
+        }
+
+        template<typename T, typename... R>
+        static void logPack(uint8_t *pos, T val, R... rest)
+        {
+            *pos++ = (uint8_t) logType(val);
+            memcpy(pos, &val, sizeof(val));
+            logPack(pos + sizeof(val), rest...);
+        }
+
+        /**
+         * @brief Queues a log frame.
+         * 
+         * @param body The id of the format string followed by the arguments.
+         * @param len The size of the body.
+         * 
+         * @return true in case of success.
+         * @return false in case of a error.
+         */
+        bool logFrame(const uint8_t *body, uint8_t len);
+
         /**
          * @brief The internal enabled state.
          */
@@ -360,6 +886,16 @@ class Insight
          */
         uint32_t Period;
 
+        /**
+         * @brief The time of the current frame, as handed over to task(...).
+         */
+        uint32_t FrameTime;
+
+        /**
+         * @brief The time of the previous frame, used for derived values.
+         */
+        uint32_t DerivedTime;
+
         /**
          * @brief The stream to use.
          */
@@ -370,7 +906,12 @@ class Insight
          * 
          * Filled by add(...), cleared by reset(...), transmitted by enable(...) 
          */
-        uint8_t NameBuffer[INSIGHT_NAMEBUFFERSIZ];
+        uint8_t *NameBuffer;
+
+        /**
+         * @brief The size of the name buffer.
+         */
+        uint8_t NameBufferSiz;
 
         /**
          * @brief The current position in the name buffer.
@@ -380,12 +921,12 @@ class Insight
         /**
          * @brief The Array holding the data needed for transmitting data.
          */
-        struct {
-            
-            void            *ptr;   /** The point tot the data */
-            dataTypes_t     type;   /** The type of the data */
+        Payload_t *Payload;
 
-        } Payload[INSIGHT_NUMVALUES];
+        /**
+         * @brief The number of elements of the payload array.
+         */
+        uint8_t NumValues;
 
         /**
          * @brief The number of used payload elements.
@@ -393,10 +934,545 @@ class Insight
          */
         uint8_t PayloadIdx;
 
+        /**
+         * @brief The copy operations collecting the payload, see compile().
+         */
+        CopyOp_t *CopyOps;
+
+        /**
+         * @brief The number of used copy operations.
+         */
+        uint8_t CopyOpsIdx;
+
+        /**
+         * @brief Transmits the wire layout as part of the header.
+         * 
+         * As values are transmitted in their native representation the host 
+         * has to know it. The 'W' entry tells the byte order, 'L'ittle or 
+         * 'B'ig endian, the size of bool in bytes and the formats of float 
+         * and double. 'F' followed by the number of bits stands for IEEE 754, 
+         * 'X' for anything else, e.g. "W=L,1,F32,F64;".
+         */
+        void printLayout(void);
+
+        /**
+         * @brief True if the aligned layout is used, see setAligned(...).
+         */
+        bool Aligned;
+
+        /**
+         * @brief The number of zero bytes appended to the payload.
+         */
+        uint8_t PadSize;
+
+        /**
+         * @brief Translates the payload array into copy operations.
+         * 
+         * Called by enable(...) as the payload array is locked from this time 
+         * on. Sorts the payload array according to the layout first. Variables
+         * at adjacent addresses, e.g. members of a struct, are merged into a 
+         * single copy operation.
+         * 
+         * @return true in case of success.
+         * @return false if the padded payload does not fit into a frame.
+         */
+        bool compile(void);
+
         /**
          * @brief The number of payload bytes to transmit.
          */
         uint8_t PayloadSize;
+
+        /**
+         * @brief The max payload size of a data frame, also the size of each 
+         * data frame kept by ARQ, FEC or the encoding.
+         */
+        uint8_t FrameSiz;
+
+        /**
+         * @brief The Array holding the state of derived values.
+         */
+        Derived_t *Derived;
+
+        /**
+         * @brief The number of elements of the derived value array.
+         */
+        uint8_t NumDerived;
+
+        /**
+         * @brief The number of used derived values.
+         */
+        uint8_t DerivedIdx;
+
+        /**
+         * @brief Updates all derived values, see addDerived(...).
+         */
+        void updateDerived(void);
+
+        /**
+         * @brief The kernels computing derived values, one per derivedTypes_t.
+         * 
+         * @param pDrv The derived value to update.
+         * @param x The current value of the source.
+         * @param dx The difference to the previous value of the source.
+         * @param dt The time since the previous frame in seconds.
+         */
+        static void deriveDelta(Derived_t *pDrv, float x, float dx, float dt);
+        static void deriveRate(Derived_t *pDrv, float x, float dx, float dt);
+        static void deriveIntegral(Derived_t *pDrv, float x, float dx, float dt);
+        static void deriveEma(Derived_t *pDrv, float x, float dx, float dt);
+
+#if INSIGHT_NUMHISTOGRAMS > 0
+
+        /**
+         * @brief The Array holding the histograms.
+         */
+        struct {
+
+            void            *ptr;   /** The point to the data */
+            dataTypes_t     type;   /** The type of the data */
+            bool            log;    /** True if log scale is used */
+            float           min;    /** The lower limit */
+            float           max;    /** The upper limit */
+            float           scale;  /** Buckets per unit in linear scale */
+
+            /** The upper bucket limits in log scale */
+            float           edges[INSIGHT_HISTBUCKETS - 1];
+
+            /** The buckets, sample() fills one set while the other is sent */
+            uint16_t        bins[2][INSIGHT_HISTBUCKETS];
+
+        } Histogram[INSIGHT_NUMHISTOGRAMS];
+
+        /**
+         * @brief The number of used histograms.
+         */
+        uint8_t HistogramIdx;
+
+        /**
+         * @brief The set of buckets used by sample().
+         */
+        volatile uint8_t HistogramBank;
+
+#endif
+
+        /**
+         * @brief Transmits and clears all histograms.
+         */
+        void transmitHistograms(void);
+
+#if INSIGHT_NUMSPECTRA > 0
+
+        /**
+         * @brief The Array holding the spectra.
+         */
+        struct {
+
+            void            *ptr;   /** The point to the data */
+            dataTypes_t     type;   /** The type of the data */
+            bool            window; /** True if the Hann window is used */
+            uint8_t         peaks;  /** The number of peaks, 0 for all bins */
+
+            /** The sliding window of samples */
+            float           samples[INSIGHT_SPECTRUMSIZ];
+
+        } Spectrum[INSIGHT_NUMSPECTRA];
+
+        /**
+         * @brief The number of used spectra.
+         */
+        uint8_t SpectrumIdx;
+
+        /**
+         * @brief The position of the next sample in all sliding windows.
+         */
+        volatile uint16_t SpectrumPos;
+
+        /**
+         * @brief cos(2*pi*k/INSIGHT_SPECTRUMSIZ) for the first half period. 
+         * Used for the FFT as well as for the window.
+         */
+        float SpectrumCos[INSIGHT_SPECTRUMSIZ/2 + 1];
+
+        /**
+         * @brief The buffers used to compute the FFT, shared by all spectra.
+         */
+        float SpectrumRe[INSIGHT_SPECTRUMSIZ];
+        float SpectrumIm[INSIGHT_SPECTRUMSIZ];
+
+        /**
+         * @brief Computes the FFT of SpectrumRe and SpectrumIm in place.
+         */
+        void fft(void);
+
+#endif
+
+        /**
+         * @brief Transmits all spectra.
+         */
+        void transmitSpectra(void);
+
+#if INSIGHT_SEQUENCED
+
+        /**
+         * @brief The sequence number of the next data frame.
+         */
+        uint8_t Seq;
+
+#endif
+
+#if INSIGHT_ARQWINDOW > 0
+
+        /**
+         * @brief The data frames kept for retransmission, indexed by the lower 
+         * bits of the sequence number.
+         */
+        struct {
+
+            uint8_t         seq;    /** The sequence number */
+            uint8_t         state;  /** See arqState_t in the implementation */
+            uint8_t         len;    /** The payload size */
+            uint8_t         next;   /** The 1st sequence number sent after */
+
+        } Window[INSIGHT_ARQWINDOW];
+
+        /**
+         * @brief The payloads of the window, FrameSiz bytes per frame.
+         */
+        uint8_t *WindowData;
+
+        /**
+         * @brief The buffer taking the acknowledge received from the host.
+         */
+        uint8_t AckBuffer[8];
+
+        /**
+         * @brief The number of bytes in the acknowledge buffer.
+         */
+        uint8_t AckBufferPos;
+
+        /**
+         * @brief Reads acknowledges from the stream and updates the window.
+         */
+        void receiveAck(void);
+
+        /**
+         * @brief Retransmits the oldest frame the host has asked for.
+         */
+        void retransmit(void);
+
+#endif
+
+#if INSIGHT_KEYFRAME > 0
+
+        /**
+         * @brief The payload of the previous data frame.
+         */
+        uint8_t *PrevFrame;
+
+        /**
+         * @brief The number of data frames since the last key frame.
+         */
+        uint8_t FrameCnt;
+
+        /**
+         * @brief Encodes a data frame relative to the previous one.
+         * 
+         * @param cur The payload of the current frame.
+         * @param out Takes the body of the encoded frame.
+         * 
+         * @return The size of the body.
+         */
+        uint8_t encode(const uint8_t *cur, uint8_t *out);
+
+#endif
+
+#if INSIGHT_FECBLOCK > 0
+
+        /**
+         * @brief The interleaved blocks of forward error correction.
+         */
+        struct {
+
+            uint8_t         seq;    /** The sequence number of the 1st frame */
+            uint8_t         cnt;    /** The number of frames in the block */
+
+        } Fec[INSIGHT_FECDEPTH];
+
+        /**
+         * @brief The parity data, INSIGHT_FECPARITY frames of FrameSiz bytes 
+         * per block.
+         */
+        uint8_t *FecParity;
+
+        /**
+         * @brief The block the next data frame belongs to.
+         */
+        uint8_t FecIdx;
+
+        /**
+         * @brief Adds a data frame to the current block, transmits the parity 
+         * frames if the block is complete.
+         * 
+         * @param seq The sequence number of the data frame.
+         * @param data The payload of the data frame.
+         * @param len The size of the payload.
+         */
+        void encodeFec(uint8_t seq, const uint8_t *data, uint8_t len);
+
+#endif
+
+#if INSIGHT_NUMPREDICTIVE > 0
+
+        /**
+         * @brief The Array holding the predictive coded values.
+         */
+        struct {
+
+            void            *ptr;   /** The point to the data */
+            dataTypes_t     type;   /** The type of the data */
+            uint8_t         order;  /** The order of the predictor */
+            uint8_t         cnt;    /** The number of samples */
+
+            /** The samples of the current block */
+            uint32_t        samples[INSIGHT_RICEBLOCK];
+
+        } Predictive[INSIGHT_NUMPREDICTIVE];
+
+        /**
+         * @brief The number of used predictive coded values.
+         */
+        uint8_t PredictiveIdx;
+
+#endif
+
+        /**
+         * @brief Samples all predictive coded values and transmits full 
+         * blocks.
+         */
+        void transmitPredictive(void);
+
+        /**
+         * @brief Reads a variable of any type as float.
+         * 
+         * @param ptr The pointer to the variable.
+         * @param type The type of the variable.
+         * @return The value.
+         */
+        static float toFloat(const void *ptr, dataTypes_t type);
+
+        /**
+         * @brief The strings transmitted in the header in addition to the 
+         * variable names, e.g. the names of markers.
+         */
+        String_t *Strings;
+
+        /**
+         * @brief The number of elements of the string table.
+         */
+        uint8_t NumStrings;
+
+        /**
+         * @brief The number of used string table entries.
+         */
+        uint8_t StringsIdx;
+
+        /**
+         * @brief Queues event frames until they get transmitted.
+         */
+        InsightRing Events;
+
+        /**
+         * @brief Queues log messages until they get transmitted.
+         */
+        InsightRing Logs;
+
+        /**
+         * @brief Queues large frames until they get transmitted in segments.
+         */
+        InsightRing Bulk;
+
+        /**
+         * @brief Transmits a single data frame and queues large frames, see 
+         * transmit() and task(...).
+         * 
+         * @return true in case of success. 
+         * @return false if the transmission has not been enabled before. 
+         */
+        bool transmitData(void);
+
+        /**
+         * @brief The number of queued bytes which belong to the frame already
+         * partially sent by the previous segment.
+         */
+        uint16_t BulkSkip;
+
+        /**
+         * @brief The number of large frames dropped, see getDropped().
+         */
+        uint32_t Dropped;
+
+        /**
+         * @brief Queues a large frame, counts it as dropped if there is not 
+         * enough space left.
+         * 
+         * @param ctrlChar The control character of the frame.
+         * @param body1 The first part of the body.
+         * @param len1 The size of the first part.
+         * @param body2 The optional second part of the body.
+         * @param len2 The size of the second part.
+         */
+        void queueBulk(uint8_t ctrlChar, const void *body1, uint8_t len1,
+                const void *body2=0, uint8_t len2=0);
+
+        /**
+         * @brief Transmits the next segment of queued large frames.
+         */
+        void transmitSegment(void);
+
+        /**
+         * @brief Adds a entry to the string table.
+         * 
+         * @param tag The kind of string.
+         * @param id The id the string belongs to.
+         * @param str The string.
+         * @return true in case of success.
+         * @return false if enabled or the table is full.
+         */
+        bool addString(char tag, uint16_t id, const char *str);
+
+        /**
+         * @brief Writes all queued markers and log messages to the stream.
+         */
+        void flushEvents(void);
+};
+
+/**
+ * @brief The storage of N elements of type T. Unlike a array it takes no 
+ * memory if N is zero, the data pointer is NULL in this case.
+ */
+template<typename T, size_t N>
+struct InsightArray
+{
+    T data[N];
+};
+
+template<typename T>
+struct InsightArray<T, 0>
+{
+    static constexpr T *data = 0;
 };
 
+/**
+ * @brief A data stream providing the storage for the given capacities.
+ * 
+ * Each instance can be sized exactly for it's needs, e.g. a library might use 
+ * it's own diagnostic stream independent of the application. The capacities 
+ * default to config.hpp. Features which are disabled there by default, like 
+ * histograms, spectra, predictive coding, ARQ and FEC, take no memory unless 
+ * enabled, neither do capacities of zero. The data frames kept by ARQ, FEC and the encoding are sized by 
+ * NUMVALUES.
+ * 
+ * @tparam NUMVALUES The number of values which can be added to the stream.
+ * @tparam NAMEBUFFERSIZ The size of the buffer taking the variable names.
+ * @tparam EVENTBUFFERSIZ The size of the event queue, a power of two. Zero 
+ *                        disables markers.
+ * @tparam LOGBUFFERSIZ The size of the log queue, a power of two. Zero disables
+ *                      log messages.
+ * @tparam BULKBUFFERSIZ The size of the large frame queue, a power of two.
+ *                       Zero disables large frames.
+ * @tparam NUMSTRINGS The number of entries of the string table.
+ * @tparam NUMDERIVED The number of derived values.
+ */
+template<uint8_t NUMVALUES, uint8_t NAMEBUFFERSIZ, 
+        uint16_t EVENTBUFFERSIZ = INSIGHT_EVENTBUFFERSIZ,
+        uint16_t LOGBUFFERSIZ = INSIGHT_LOGBUFFERSIZ,
+        uint16_t BULKBUFFERSIZ = INSIGHT_BULKBUFFERSIZ,
+        uint8_t NUMSTRINGS = INSIGHT_NUMSTRINGS,
+        uint8_t NUMDERIVED = INSIGHT_NUMDERIVED>
+class InsightSized : public InsightBase
+{
+    /**
+     * @brief The max payload of a data frame, one byte is taken by the 
+     * sequence number and one by the parity index.
+     */
+    static const uint8_t FRAMESIZ = 
+            (NUMVALUES*8 < UINT8_MAX - 2) ? NUMVALUES*8 : UINT8_MAX - 2;
+
+    static_assert(NUMVALUES > 0 && NAMEBUFFERSIZ > 0, "Invalid capacities");
+    static_assert((EVENTBUFFERSIZ & (EVENTBUFFERSIZ - 1)) == 0 &&
+            (LOGBUFFERSIZ & (LOGBUFFERSIZ - 1)) == 0 &&
+            (BULKBUFFERSIZ & (BULKBUFFERSIZ - 1)) == 0, 
+            "The queue sizes have to be a power of two");
+
+    /* All parity frames of a block are queued at once. A parity frame takes 
+     * the payload, the sequence number, the parity index and the header. */
+    static_assert(INSIGHT_FECBLOCK == 0 || 
+            INSIGHT_FECPARITY*(FRAMESIZ + 4) <= BULKBUFFERSIZ,
+            "Parity frames exceed BULKBUFFERSIZ, increase it");
+
+    public:
+
+        /**
+         * @brief Construct a new Insight object
+         */
+        InsightSized() : 
+            InsightBase(Storage_t {PayloadStorage, CopyOpStorage, NUMVALUES, 
+                    NameStorage, NAMEBUFFERSIZ, 
+                    EventStorage.data, EVENTBUFFERSIZ,
+                    LogStorage.data, LOGBUFFERSIZ, 
+                    BulkStorage.data, BULKBUFFERSIZ, 
+                    StringStorage.data, NUMSTRINGS, 
+                    DerivedStorage.data, NUMDERIVED, 
+                    FrameStorage.data, FRAMESIZ})
+        {
+
+        }
+
+    private:
+
+        /**
+         * @brief The storage of the variables.
+         */
+        Payload_t PayloadStorage[NUMVALUES];
+
+        /**
+         * @brief The storage of the copy operations.
+         */
+        CopyOp_t CopyOpStorage[NUMVALUES];
+
+        /**
+         * @brief The storage of the variable names.
+         */
+        uint8_t NameStorage[NAMEBUFFERSIZ];
+
+        /**
+         * @brief The storage of the queues.
+         */
+        InsightArray<uint8_t, EVENTBUFFERSIZ> EventStorage;
+        InsightArray<uint8_t, LOGBUFFERSIZ> LogStorage;
+        InsightArray<uint8_t, BULKBUFFERSIZ> BulkStorage;
+
+        /**
+         * @brief The storage of the string table.
+         */
+        InsightArray<String_t, NUMSTRINGS> StringStorage;
+
+        /**
+         * @brief The storage of the derived values.
+         */
+        InsightArray<Derived_t, NUMDERIVED> DerivedStorage;
+
+        /**
+         * @brief The storage of the data frames kept by ARQ, FEC and the 
+         * encoding.
+         */
+        InsightArray<uint8_t, INSIGHT_NUMFRAMEBUFFERS * FRAMESIZ> FrameStorage;
+};
+
+/**
+ * @brief The data stream using the default capacities defined by config.hpp.
+ */
+typedef InsightSized<INSIGHT_NUMVALUES, INSIGHT_NAMEBUFFERSIZ> Insight;
+
 #endif /* INSIGHT_HPP_ */
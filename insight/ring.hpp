@@ -0,0 +1,232 @@
+/*
+ * libinsight, a libary to stream data in binary form to a host computer.
+ *
+ * Copyright (C) 2021 Julian Friedrich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * You can file issues at https://github.com/fjulian79/libinsight/issues
+ */
+
+#ifndef INSIGHT_RING_HPP_
+#define INSIGHT_RING_HPP_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * @brief A byte ring buffer taking complete frames.
+ *
+ * Frames are stored as control character, length byte and body, which is
+ * exactly what is written to the stream later on.
+ *
+ * The buffer is lock free as long as there is only one producer calling put()
+ * and one consumer calling peek() and drop(). The producer might be an
+ * interrupt service routine, but all calls of put() have to be made from the 
+ * same execution context: either the main loop or a single interrupt. If the 
+ * main loop and a interrupt, or two interrupts, call put() they might reserve 
+ * the same space and corrupt the buffer. A frame becomes visible to the 
+ * consumer only after it has been written completely, so the consumer never 
+ * sees a partial frame.
+ *
+ * The buffer does not own it's storage, see InsightSized.
+ */
+class InsightRing
+{
+    public:
+
+        /**
+         * @brief Construct a new, empty ring buffer.
+         *
+         * @param pBuffer The storage of the buffer.
+         * @param siz The size of the storage in bytes, has to be a power of 
+         *            two, 32768 at most. Zero disables the buffer, every 
+         *            put() fails.
+         */
+        InsightRing(uint8_t *pBuffer, uint16_t siz) : 
+            Head(0), Tail(0), Siz(siz), Buffer(pBuffer) {}
+
+        /**
+         * @brief Drops all data. Must only be called by the consumer.
+         */
+        void clear(void)
+        {
+            Tail = Head;
+        }
+
+        /**
+         * @brief Tells if there is data to consume.
+         */
+        bool isEmpty(void)
+        {
+            return Head == Tail;
+        }
+
+        /**
+         * @brief Tells the number of bytes to consume.
+         */
+        uint16_t size(void)
+        {
+            return Head - Tail;
+        }
+
+        /**
+         * @brief Reads a byte without consuming it.
+         *
+         * @param offset The position relative to the first byte to consume, 
+         *               has to be less than size().
+         *
+         * @return The byte.
+         */
+        uint8_t at(uint16_t offset)
+        {
+            return Buffer[(uint16_t)(Tail + offset) & (Siz - 1)];
+        }
+
+        /**
+         * @brief Adds a frame to the buffer, may only be called by the producer.
+         *
+         * @param ctrl The control character of the frame.
+         * @param body The body of the frame.
+         * @param len The size of the body.
+         *
+         * @return true in case of success.
+         * @return false if there is not enough space left, nothing is written.
+         */
+        bool put(uint8_t ctrl, const void *body, uint8_t len)
+        {
+            return put(ctrl, body, len, 0, 0);
+        }
+
+        /**
+         * @brief Same as above but the body is taken from two places, which
+         * saves a temporary buffer in the callers context.
+         *
+         * @param ctrl The control character of the frame.
+         * @param body1 The first part of the body.
+         * @param len1 The size of the first part.
+         * @param body2 The second part of the body.
+         * @param len2 The size of the second part.
+         *
+         * @return true in case of success.
+         * @return false if there is not enough space left or the body is too
+         *         large, nothing is written.
+         */
+        bool put(uint8_t ctrl, const void *body1, uint8_t len1,
+                const void *body2, uint8_t len2)
+        {
+            uint16_t head = Head;
+            uint16_t len = len1 + len2;
+
+            if ((len > UINT8_MAX) ||
+                ((uint16_t)(Siz - (uint16_t)(head - Tail)) < len + 2))
+            {
+                return false;
+            }
+
+            Buffer[head++ & (Siz - 1)] = ctrl;
+            Buffer[head++ & (Siz - 1)] = (uint8_t) len;
+            head = copy(head, body1, len1);
+            head = copy(head, body2, len2);
+
+            /* Make sure the frame is in memory before it gets published. */
+            __sync_synchronize();
+            Head = head;
+
+            return true;
+        }
+
+        /**
+         * @brief Provides the next block of continuous data to consume.
+         *
+         * As the data might wrap around at the end of the buffer two calls
+         * might be needed to get all of it.
+         *
+         * @param ppData Takes the pointer to the data.
+         *
+         * @return The number of bytes available at *ppData.
+         */
+        uint16_t peek(const uint8_t **ppData)
+        {
+            uint16_t tail = Tail;
+            uint16_t used = Head - tail;
+            uint16_t pos = tail & (Siz - 1);
+
+            if (used == 0)
+            {
+                return 0;
+            }
+
+            *ppData = &Buffer[pos];
+
+            return (used < Siz - pos) ? used : Siz - pos;
+        }
+
+        /**
+         * @brief Releases consumed data, see peek(...).
+         *
+         * @param cnt The number of bytes to release.
+         */
+        void drop(uint16_t cnt)
+        {
+            __sync_synchronize();
+            Tail += cnt;
+        }
+
+    private:
+
+        /**
+         * @brief Copies data to the buffer without publishing it.
+         *
+         * @param head The position to write to.
+         * @param data The data to copy.
+         * @param len The number of bytes to copy.
+         *
+         * @return The new write position.
+         */
+        uint16_t copy(uint16_t head, const void *data, uint8_t len)
+        {
+            const uint8_t *src = (const uint8_t*) data;
+
+            for (uint8_t i = 0; i < len; i++)
+            {
+                Buffer[head++ & (Siz - 1)] = src[i];
+            }
+
+            return head;
+        }
+
+        /**
+         * @brief The write position, only modified by the producer.
+         */
+        volatile uint16_t Head;
+
+        /**
+         * @brief The read position, only modified by the consumer.
+         */
+        volatile uint16_t Tail;
+
+        /**
+         * @brief The size of the buffer.
+         */
+        const uint16_t Siz;
+
+        /**
+         * @brief The frame data.
+         */
+        uint8_t * const Buffer;
+};
+
+#endif /* INSIGHT_RING_HPP_ */
@@ -0,0 +1,97 @@
+/*
+ * libinsight, a libary to stream data in binary form to a host computer.
+ *
+ * Copyright (C) 2021 Julian Friedrich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * You can file issues at https://github.com/fjulian79/libinsight/issues
+ */
+
+#ifndef ARDUINO_H_
+#define ARDUINO_H_
+
+/**
+ * A minimal stand-in for the Arduino core, just enough to build libinsight 
+ * natively, see sim.cpp.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+/**
+ * @brief The stream interface used by libinsight. Writes are discarded and 
+ * nothing is received unless a derived class says otherwise.
+ */
+class Stream
+{
+    public:
+
+        virtual ~Stream() {}
+
+        virtual size_t write(uint8_t c)
+        {
+            (void) c;
+            return 1;
+        }
+
+        size_t write(const uint8_t *buffer, size_t size)
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                write(buffer[i]);
+            }
+
+            return size;
+        }
+
+        int printf(const char *format, ...) 
+                __attribute__ ((format (printf, 2, 3)))
+        {
+            char buffer[256];
+            va_list args;
+
+            va_start(args, format);
+            int len = vsnprintf(buffer, sizeof(buffer), format, args);
+            va_end(args);
+
+            if (len > (int) sizeof(buffer) - 1)
+            {
+                len = sizeof(buffer) - 1;
+            }
+
+            if (len > 0)
+            {
+                write((const uint8_t*) buffer, len);
+            }
+
+            return len;
+        }
+
+        virtual int available(void)
+        {
+            return 0;
+        }
+
+        virtual int read(void)
+        {
+            return -1;
+        }
+};
+
+extern Stream Serial;
+
+#endif /* ARDUINO_H_ */
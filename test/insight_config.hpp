@@ -0,0 +1,30 @@
+/*
+ * libinsight, a libary to stream data in binary form to a host computer.
+ *
+ * Copyright (C) 2021 Julian Friedrich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * You can file issues at https://github.com/fjulian79/libinsight/issues
+ */
+
+#ifndef INSIGHT_CONFIG_HPP_TEST_
+#define INSIGHT_CONFIG_HPP_TEST_
+
+/**
+ * The native build has no libversion, so the binary info is given here.
+ */
+#define INSIGHT_BINARYINFO_FMT      "%s; %s; %s;", "sim", "native", __DATE__
+
+#endif /* INSIGHT_CONFIG_HPP_TEST_ */
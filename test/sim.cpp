@@ -0,0 +1,381 @@
+/*
+ * libinsight, a libary to stream data in binary form to a host computer.
+ *
+ * Copyright (C) 2021 Julian Friedrich
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * You can file issues at https://github.com/fjulian79/libinsight/issues
+ */
+
+/**
+ * A simulator of the task scheduling driven by a virtual clock.
+ * 
+ * task(...), enable(..., sync) and pause(..., sync) depend on the timing of 
+ * the calls and on the wraparound of the 32 bit millis() counter, which is 
+ * hard to test on hardware. This simulator calls task(...) with a virtual 
+ * clock, the time between two calls is random up to the given jitter, and 
+ * every now and then the main loop stalls. As the clock jumps from call to 
+ * call, simulating a day takes a fraction of a second. The clock starts right
+ * in front of the wraparound.
+ * 
+ * Each scheduling mode is checked against a model of the scheduler using 64 
+ * bit time, which never wraps around: A data frame has to be sent by exactly 
+ * those calls where more than one period has passed since the previous frame 
+ * or a sync has been requested. The achieved period and the number of frames 
+ * lost compared to the nominal period are reported per mode. Pauses last up to
+ * 50 periods, the library can't tell pauses longer than the wraparound of 
+ * millis() from short ones, so periods above 23 hours might report errors in
+ * the pause mode.
+ * 
+ * Usage: sim [-h hours] [-p period] [-j jitter] [-s stalls] [-l stall] 
+ *            [-r seed]
+ * 
+ * -h   The simulated time per mode in hours, default 24.
+ * -p   The period of the task in ms, default INSIGHT_TASKPERIOD_MS.
+ * -j   The max time between two calls of task(...) in ms, default 10.
+ * -s   The average number of calls between two stalls, 0 disables stalls, 
+ *      default 10000.
+ * -l   The max duration of a stall in ms, default three periods.
+ * -r   The seed of the random numbers, default 1.
+ * 
+ * Returns zero if all modes behave as expected.
+ */
+
+#include "insight/insight.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+Stream Serial;
+
+/**
+ * @brief The options of the simulation, see above.
+ */
+typedef struct {
+
+    double          hours;
+    uint32_t        period;
+    uint32_t        jitter;
+    uint32_t        stalls;
+    uint32_t        stall;
+    uint32_t        seed;
+
+} Options_t;
+
+/**
+ * @brief The scheduling modes to simulate.
+ */
+typedef enum {
+
+    mode_enable     = 0,    /** enable(true), runs until the end */
+    mode_sync       = 1,    /** enable(true, true), runs until the end */
+    mode_pause      = 2,    /** Paused and resumed by pause(false) */
+    mode_pauseSync  = 3,    /** Paused and resumed by pause(false, true) */
+    mode_num
+
+}Mode_t;
+
+static const char * const ModeName[mode_num] = 
+{
+    "enable", "enable sync", "pause", "pause sync"
+};
+
+/**
+ * @brief A stream counting the data frames written to it.
+ * 
+ * The header is delimited by SOH and ETX, EOT is a single byte, all other 
+ * frames are made of the control character, the length and the body.
+ */
+class FrameCounter : public Stream
+{
+    public:
+
+        FrameCounter() : Frames(0), State(state_idle), Ctrl(0), Left(0) {}
+
+        using Stream::write;
+
+        size_t write(uint8_t c)
+        {
+            switch (State)
+            {
+                case state_idle:
+                    if (c == 0x01)
+                    {
+                        State = state_header;
+                    }
+                    else if (c != 0x04)
+                    {
+                        Ctrl = c;
+                        State = state_length;
+                    }
+                    break;
+
+                case state_header:
+                    if (c == 0x03)
+                    {
+                        State = state_idle;
+                    }
+                    break;
+
+                case state_length:
+                    Left = c;
+                    if (Left == 0)
+                    {
+                        complete();
+                    }
+                    else
+                    {
+                        State = state_body;
+                    }
+                    break;
+
+                case state_body:
+                    if (--Left == 0)
+                    {
+                        complete();
+                    }
+                    break;
+            }
+
+            return 1;
+        }
+
+        /**
+         * @brief The number of data frames, plain or encoded.
+         */
+        uint64_t Frames;
+
+    private:
+
+        void complete(void)
+        {
+            if ((Ctrl == 0x02) || (Ctrl == 0x1a))
+            {
+                Frames++;
+            }
+
+            State = state_idle;
+        }
+
+        enum {
+            state_idle,
+            state_header,
+            state_length,
+            state_body
+        } State;
+
+        uint8_t Ctrl;
+        uint8_t Left;
+};
+
+/**
+ * @brief A xorshift random number generator, so runs are reproducible.
+ */
+static uint32_t Random;
+
+static uint32_t rnd(uint32_t max)
+{
+    Random ^= Random << 13;
+    Random ^= Random >> 17;
+    Random ^= Random << 5;
+
+    return Random % max;
+}
+
+/**
+ * @brief Simulates one mode and prints the results.
+ * 
+ * @param opt The options.
+ * @param mode The mode to simulate.
+ * 
+ * @return true if the scheduler behaved as expected.
+ */
+static bool simulate(const Options_t &opt, Mode_t mode)
+{
+    const bool sync = (mode == mode_sync) || (mode == mode_pauseSync);
+    const bool pausing = (mode == mode_pause) || (mode == mode_pauseSync);
+    const int64_t period = opt.period;
+
+    Insight ins;
+    FrameCounter io;
+    uint32_t value = 0;
+
+    /* The clock starts ten minutes before the wraparound. */
+    int64_t now = (int64_t) UINT32_MAX + 1 - 600000;
+    int64_t end = now + (int64_t)(opt.hours * 3600000.0);
+    int64_t phaseEnd = now;
+    int64_t active = 0;
+
+    /* The model of the scheduler, the library starts with LastTick = 0. */
+    int64_t lastTick = 0;
+    int64_t lastFrame = -1;
+    bool paused = false;
+
+    int64_t minPeriod = INT64_MAX;
+    int64_t maxPeriod = 0;
+    int64_t sumPeriod = 0;
+    uint64_t numPeriod = 0;
+    uint64_t errors = 0;
+    uint64_t calls = 0;
+
+    Random = opt.seed;
+    ins.setStream(&io);
+    ins.setPeriod(opt.period);
+    ins.add(&value, "value");
+
+    if (!ins.enable(true, mode == mode_sync))
+    {
+        printf("%-12s enable(true) failed\n", ModeName[mode]);
+        return false;
+    }
+
+    if (mode == mode_sync)
+    {
+        lastTick -= 2 * period;
+    }
+
+    while (now < end)
+    {
+        /* Pause and resume after up to 50 periods. */
+        if (pausing && (now >= phaseEnd))
+        {
+            paused = !paused;
+            ins.pause(paused, !paused && sync);
+            phaseEnd = now + 1 + rnd(50 * opt.period);
+
+            if (!paused && sync)
+            {
+                lastTick -= 2 * period;
+            }
+
+            /* The period is not measured across a pause. */
+            lastFrame = -1;
+        }
+
+        uint64_t frames = io.Frames;
+        bool expected = !paused && (now - lastTick > period);
+
+        value++;
+        ins.task((uint32_t) now);
+        calls++;
+
+        if ((io.Frames - frames) != (expected ? 1 : 0))
+        {
+            if (errors++ < 10)
+            {
+                printf("%-12s call at %" PRId64 " ms (millis %" PRIu32 "): "
+                        "%" PRIu64 " frames sent, expected %d\n", 
+                        ModeName[mode], now, (uint32_t) now, 
+                        io.Frames - frames, expected ? 1 : 0);
+            }
+        }
+
+        if (expected)
+        {
+            if (lastFrame >= 0)
+            {
+                int64_t diff = now - lastFrame;
+
+                minPeriod = diff < minPeriod ? diff : minPeriod;
+                maxPeriod = diff > maxPeriod ? diff : maxPeriod;
+                sumPeriod += diff;
+                numPeriod++;
+            }
+
+            lastTick = now;
+            lastFrame = now;
+        }
+
+        /* The main loop takes a while, sometimes even longer. */
+        int64_t step = 1 + rnd(opt.jitter);
+
+        if ((opt.stalls > 0) && (rnd(opt.stalls) == 0))
+        {
+            step += rnd(opt.stall + 1);
+        }
+
+        if (!paused)
+        {
+            active += step;
+        }
+
+        now += step;
+    }
+
+    /* Frames lost compared to a ideal scheduler running at the period. */
+    int64_t nominal = active / period;
+    int64_t lost = nominal - (int64_t) io.Frames;
+
+    printf("%-12s %12" PRIu64 " %12" PRIu64 " %10" PRId64 " %6.2f%% "
+            "%6" PRId64 " %9.2f %6" PRId64 " %8" PRIu64 "\n", 
+            ModeName[mode], calls, io.Frames, lost, 
+            nominal ? 100.0 * lost / nominal : 0.0, 
+            numPeriod ? minPeriod : 0, 
+            numPeriod ? (double) sumPeriod / numPeriod : 0.0, 
+            maxPeriod, errors);
+
+    return errors == 0;
+}
+
+int main(int argc, char **argv)
+{
+    Options_t opt = {24, INSIGHT_TASKPERIOD_MS, 10, 10000, 0, 1};
+    bool stallSet = false;
+    bool ok = true;
+    int c;
+
+    while ((c = getopt(argc, argv, "h:p:j:s:l:r:")) != -1)
+    {
+        switch (c)
+        {
+            case 'h':   opt.hours = atof(optarg); break;
+            case 'p':   opt.period = strtoul(optarg, 0, 0); break;
+            case 'j':   opt.jitter = strtoul(optarg, 0, 0); break;
+            case 's':   opt.stalls = strtoul(optarg, 0, 0); break;
+            case 'l':   opt.stall = strtoul(optarg, 0, 0); stallSet = true; 
+                        break;
+            case 'r':   opt.seed = strtoul(optarg, 0, 0); break;
+            default:    return 2;
+        }
+    }
+
+    if (!stallSet)
+    {
+        opt.stall = 3 * opt.period;
+    }
+
+    if ((opt.hours <= 0) || (opt.period == 0) || (opt.jitter == 0) || 
+        (opt.seed == 0))
+    {
+        printf("Invalid options\n");
+        return 2;
+    }
+
+    printf("%.1f hours per mode, period %" PRIu32 " ms, jitter %" PRIu32 
+            " ms, stalls up to %" PRIu32 " ms every %" PRIu32 " calls\n\n", 
+            opt.hours, opt.period, opt.jitter, opt.stall, opt.stalls);
+    printf("%-12s %12s %12s %10s %7s %6s %9s %6s %8s\n", "mode", "calls", 
+            "frames", "lost", "", "min", "mean", "max", "errors");
+
+    for (int m = 0; m < mode_num; m++)
+    {
+        ok &= simulate(opt, (Mode_t) m);
+    }
+
+    printf("\n%s\n", ok ? "PASSED" : "FAILED");
+
+    return ok ? 0 : 1;
+}